@@ -0,0 +1,93 @@
+#ifndef __ANOMALY_DETECTOR_H
+#define __ANOMALY_DETECTOR_H
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <stdint.h>     // host tests, see test/test_anomaly
+#define constrain(amt, low, high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+#endif
+
+enum AnomalyKind_t {
+    ANOMALY_NONE,
+    ANOMALY_SPIKE,      // single sample beyond the z limit
+    ANOMALY_SHIFT_UP,   // sustained rise, CUSUM
+    ANOMALY_SHIFT_DOWN, // sustained fall, CUSUM
+    ANOMALY_CLEARED,    // back within baseline
+    ANOMALY_REBASED     // shift persisted, its level is the new baseline
+};
+
+/**
+ * Constant memory change detector for one signal. A slow exponential
+ * baseline of mean and variance gives a z-score per sample, which
+ * drives a two sided CUSUM. Integer only; z and the CUSUM sums are in
+ * 1/16 sigma. The baseline is frozen while an anomaly is active so the
+ * shift is not learned away, and learning uses winsorised samples so
+ * one spike does not inflate the variance. A shift still active after
+ * _relearnAfter samples is a step change, not an excursion: its level,
+ * tracked while active, becomes the baseline so the next shift can be
+ * seen.
+ */
+class AnomalyDetector
+{
+public:
+    // transitions only, ANOMALY_NONE otherwise
+    AnomalyKind_t update(const int16_t x, const unsigned long nowMs);
+
+    // in signal units, floors sigma for quiet or quantised signals
+    void setMinSd(const uint8_t minSd) {
+        _minSd = minSd;
+    };
+
+    void reset() {
+        _samples = 0;
+        _active = false;
+        _activeSamples = 0;
+        _hi = _lo = 0;
+    };
+
+    bool isActive() const {
+        return _active;
+    };
+
+    // deviation of the last sample from baseline, signal units
+    int16_t getDeviation() const {
+        return _deviation;
+    };
+
+    // z-score of last sample, 1/16 sigma
+    int16_t getZ() const {
+        return _z;
+    };
+
+    // start of the excursion that raised the anomaly
+    unsigned long getOnsetMs() const {
+        return _onsetMs;
+    };
+
+private:
+    int32_t       _mean = 0;        // signal << 8
+    int32_t       _level = 0;       // fast average while active, signal << 8
+    uint32_t      _var = 0;         // signal^2 << 8
+    int16_t       _hi = 0;          // CUSUM sums, 1/16 sigma
+    int16_t       _lo = 0;
+    int16_t       _z = 0;
+    int16_t       _deviation = 0;
+    uint16_t      _samples = 0;
+    uint16_t      _activeSamples = 0;
+    unsigned long _hiStartMs = 0;
+    unsigned long _loStartMs = 0;
+    unsigned long _onsetMs = 0;
+    bool          _active = false;
+    uint8_t       _minSd = 1;
+
+    const uint8_t  _alphaShift = 12;    // baseline weight 1/4096 once warm, hours
+    const uint16_t _warmup     = 64;    // samples learned before detecting
+    const int16_t  _k          = 16;    // CUSUM slack, 1 sigma
+    const int16_t  _h          = 128;   // CUSUM threshold, 8 sigma
+    const int16_t  _zLimit     = 64;    // spike threshold, 4 sigma
+    const uint16_t _relearnAfter = 900; // samples active before rebasing, 30 min at 2s
+    const uint8_t  _levelShift = 5;     // level weight 1/32 while active
+};
+
+#endif
@@ -9,19 +9,29 @@ class ArduinoFanControl : public FanControl
 {
 public:
     // constructors
-    ArduinoFanControl(const uint8_t fans);
+    // staggered offsets each PWM channel a quarter period from the next
+    ArduinoFanControl(const uint8_t fans, const bool staggered = false);
 
     virtual RESULT initialise();
     virtual RESULT setPWMForAll(const uint16_t dutyCycle);
     virtual RESULT setPWM(const uint8_t fanid, const uint16_t dutyCycle);
+    virtual RESULT setPWMs(const uint8_t* dutyCycles);
     virtual RESULT getTachHz(const uint8_t fanid, uint16_t& tachHz);
     virtual RESULT getRPM(const uint8_t fanid, uint16_t& rpm);
+    virtual RESULT startRPMs();
+    virtual RESULT getRPMs(uint16_t* rpms);
+    virtual RESULT getTachJitter(const uint8_t fanid, uint16_t& jitterPm);
+    virtual RESULT getTachEdgeAge(const uint8_t fanid, unsigned long& ageMs);
 
 private:
     void measureTach(const uint8_t fanid, unsigned long ms);
     float readTach(const uint8_t fanid, unsigned long ms);
+    void alignTimers();
 
     uint16_t _pwmPeriod;
+    bool     _staggered;    // fans 2, 4 inverted and Timer3 offset from Timer1
+    unsigned long _tachStartMs = 0;     // startRPMs() window opened
+    bool          _tachOpen = false;    // window open, getRPMs() closes it
   
     // drives PWM PINs
     // based on https://github.com/PaulStoffregen/TimerOne/blob/master/config/known_16bit_timers.h 
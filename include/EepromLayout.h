@@ -0,0 +1,13 @@
+#ifndef __EEPROM_LAYOUT_H
+#define __EEPROM_LAYOUT_H
+
+/**
+ * EEPROM address map, 4KB on the Mega.
+ * Each block starts with a magic and version byte and is
+ * cleared by its owner when these do not match.
+ */
+#define EEPROM_PROFILE_ADDR    0    // ThermalProfile: 2 + MAX_PROFILE_ZONES * PROFILE_BUCKETS
+#define EEPROM_RUNHOURS_ADDR 400    // FanRunHours: 2 + MAX_FANS * 4
+#define EEPROM_FANHEALTH_ADDR 440   // FanHealth: 2 + MAX_FANS * HEALTH_REF_DUTIES * 5
+
+#endif
@@ -14,11 +14,14 @@ typedef int RESULT;
 // DS18B
 #define ERR_FAILED_TO_READ_TEMP   -20
 #define ERR_FAILED_TO_FIND_DEVICE -21
+#define ERR_TEMP_CRC              -22
 
 // Ethernet
 #define ERR_FAILED_TO_GET_IP_FROM_DHCP -30
 #define ERR_NO_ETHERNET_HW             -31
 #define ERR_NO_CABLE_DETECTED          -32
+#define ERR_NTP_NO_RESPONSE            -33
+#define ERR_NTP_BAD_REPLY              -34
 
 // Fanstate
 #define ERR_FAN_NOT_OPERATIONAL -40
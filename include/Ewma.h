@@ -0,0 +1,66 @@
+#ifndef __EWMA_H
+#define __EWMA_H
+
+#include <Arduino.h>
+
+/**
+ * Time weighted exponential average and slope of a raw temperature.
+ * The weight of each sample is dt / (tau + dt) from millis() deltas,
+ * so an irregular loop period does not skew either estimate. Held as
+ * raw << 8 for resolution below 1/16 C.
+ *
+ * The slope is the rate of change of the average, itself averaged with
+ * the same weight. For a steady ramp it settles on the ramp rate after
+ * a few tau.
+ */
+typedef struct {
+    int32_t       avg;      // raw << 8
+    int32_t       rate;     // raw << 8 per minute
+    unsigned long lastMs;
+    bool          primed;   // avg holds a sample
+} Ewma_t;
+
+inline void ewmaUpdate(Ewma_t& e, const int16_t raw, const unsigned long nowMs, const unsigned long tauMs) {
+
+    int32_t y = (int32_t)raw << 8;
+    if (!e.primed) {
+        e.avg = y;
+        e.rate = 0;
+        e.lastMs = nowMs;
+        e.primed = true;
+        return;
+    }
+
+    unsigned long dt = nowMs - e.lastMs;
+    if (dt == 0)
+        return;
+    e.lastMs = nowMs;
+
+    // alpha in Q16
+    int64_t alpha = ((int64_t)dt << 16) / (tauMs + dt);
+    int32_t prev = e.avg;
+    e.avg += ((int64_t)(y - e.avg) * alpha) >> 16;
+
+    int32_t inst = ((int64_t)(e.avg - prev) * 60000) / (int64_t)dt;
+    e.rate += ((int64_t)(inst - e.rate) * alpha) >> 16;
+}
+
+// average, 1/16 C
+inline int16_t ewmaRaw(const Ewma_t& e) {
+    return (e.avg + ((e.avg < 0) ? -128 : 128)) / 256;
+}
+
+// slope, milli C per minute
+inline int16_t ewmaSlope(const Ewma_t& e) {
+    int32_t mC = ((int64_t)e.rate * 1000) / (16L * 256);
+    return constrain(mC, -32767L, 32767L);
+}
+
+// format milli C per minute as C per minute, 3dp
+inline char* formatSlope(const int16_t mC, char* buf) {
+    uint16_t a = (mC < 0) ? -mC : mC;
+    sprintf(buf, "%s%u.%03u", (mC < 0) ? "-" : "", a / 1000, a % 1000);
+    return buf;
+}
+
+#endif
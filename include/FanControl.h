@@ -7,6 +7,7 @@
 
 #define MAX_DUTY_CYCLE 100  // %
 #define MIN_DUTY_CYCLE 0
+#define MAX_FANS       8    // upper bound for batched updates
 
 // assertions
 #define ASSERT_RANGE(var, min, max, msg) if(var<min || var>max) { \
@@ -33,9 +34,60 @@ public:
     virtual RESULT initialise() = 0;
     virtual RESULT setPWMForAll(const uint16_t dutyCycle) = 0;
     virtual RESULT setPWM(const uint8_t fanid, const uint16_t dutyCycle) = 0;
+
+    /**
+     * Batched update of all fans, dutyCycles[0] is fanid 1.
+     * Sub types override to apply all channels together.
+     */
+    virtual RESULT setPWMs(const uint8_t* dutyCycles) {
+        RESULT res = RES_OK;
+        for (uint8_t i = 0; i < _fans; i++) {
+            RESULT r = setPWM(i+1, dutyCycles[i]);
+            if (r != RES_OK)
+                res = r;
+        }
+        return res;
+    };
     virtual RESULT getTachHz(const uint8_t fanid, uint16_t& tachHz) = 0;
     virtual RESULT getRPM(const uint8_t fanid, uint16_t& rpm) = 0;
 
+    /**
+     * Rpm of all fans, rpms[0] is fanid 1. Sub types that count tach
+     * edges override both, startRPMs() opening one window for all fans
+     * and getRPMs() closing it, so the caller chooses how to wait. By
+     * default getRPMs() measures each fan in turn.
+     */
+    virtual RESULT startRPMs() {
+        return RES_OK;
+    };
+    virtual RESULT getRPMs(uint16_t* rpms) {
+        RESULT res = RES_OK;
+        for (uint8_t i = 0; i < _fans; i++) {
+            RESULT r = getRPM(i+1, rpms[i]);
+            if (r != RES_OK)
+                res = r;
+        }
+        return res;
+    };
+
+    /**
+     * Time since the last tach edge, for stall detection between
+     * rpm measurements.
+     */
+    virtual RESULT getTachEdgeAge(const uint8_t fanid, unsigned long& ageMs) {
+        ageMs = 0;
+        return ERR_METHOD_NOT_IMPLEMENTED;
+    };
+
+    /**
+     * Mean cycle to cycle change in tach period as 0.1% of the period,
+     * since the last call. Worn bearings show as rising jitter.
+     */
+    virtual RESULT getTachJitter(const uint8_t fanid, uint16_t& jitterPm) {
+        jitterPm = 0;
+        return ERR_METHOD_NOT_IMPLEMENTED;
+    };
+
     const uint8_t getFanCount() const {
         return _fans;
     };
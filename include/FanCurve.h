@@ -0,0 +1,102 @@
+#ifndef __FAN_CURVE_H
+#define __FAN_CURVE_H
+
+#include <Arduino.h>
+#include "TempRaw.h"
+
+/**
+ * Piecewise-linear fan curves (temp -> duty %) expanded at compile
+ * time into a PROGMEM lookup table indexed by raw temperature, so the
+ * runtime cost is a single pgm_read_byte.
+ *
+ * Define a curve as an array of breakpoints in ascending temp:
+ *
+ *   constexpr FanCurvePoint_t QUIET[] = {
+ *       { TEMP_RAW(20), 40 }, { TEMP_RAW(30), 100 } };
+ *
+ * then FanCurveLUT<QUIET, 2>::lookup is the curve's lookup function.
+ */
+#define FANCURVE_LUT_SHIFT 2    // one entry per 4 raw = 0.25 C
+#define FANCURVE_LUT_SIZE  256  // covers 0 - 63.75 C
+
+typedef struct {
+    int16_t tempRaw;    // breakpoint, 1/16 C
+    uint8_t duty;       // %
+} FanCurvePoint_t;
+
+/**
+ * Interpolate duty for raw temp t over n breakpoints p.
+ * Single return statement to remain C++11 constexpr.
+ */
+constexpr uint8_t fanCurveDuty(const FanCurvePoint_t* p, const uint8_t n, const int16_t t) {
+    return (n == 1 || t <= p[0].tempRaw) ? p[0].duty :
+           (t < p[1].tempRaw) ?
+               (uint8_t)(p[0].duty + ((int32_t)(p[1].duty - p[0].duty) * (t - p[0].tempRaw)) /
+                                     (p[1].tempRaw - p[0].tempRaw)) :
+           fanCurveDuty(p + 1, n - 1, t);
+}
+
+// C++11 has no std::make_integer_sequence
+template<uint16_t... I> struct FanCurveIndices {};
+
+template<uint16_t N, uint16_t... I>
+struct FanCurveMakeIndices : FanCurveMakeIndices<N-1, N-1, I...> {};
+
+template<uint16_t... I>
+struct FanCurveMakeIndices<0, I...> {
+    typedef FanCurveIndices<I...> type;
+};
+
+template<const FanCurvePoint_t* P, uint8_t N,
+         typename Seq = typename FanCurveMakeIndices<FANCURVE_LUT_SIZE>::type>
+struct FanCurveLUT;
+
+template<const FanCurvePoint_t* P, uint8_t N, uint16_t... I>
+struct FanCurveLUT<P, N, FanCurveIndices<I...> > {
+
+    static const uint8_t table[sizeof...(I)];
+
+    static uint8_t lookup(const int16_t raw) {
+        int16_t i = raw >> FANCURVE_LUT_SHIFT;
+        if (i < 0)
+            i = 0;
+        else if (i >= (int16_t)sizeof...(I))
+            i = sizeof...(I) - 1;
+        return pgm_read_byte(&table[i]);
+    };
+};
+
+template<const FanCurvePoint_t* P, uint8_t N, uint16_t... I>
+const uint8_t FanCurveLUT<P, N, FanCurveIndices<I...> >::table[sizeof...(I)] PROGMEM = {
+    fanCurveDuty(P, N, (int16_t)(I << FANCURVE_LUT_SHIFT))...
+};
+
+/**
+ * Runtime state for one curve.
+ * Duty rises as soon as the curve demands it. It only falls once the
+ * temp is a hysteresis band below the breakpoint that raised it, and
+ * no sooner than dwellMs after the last change.
+ */
+class FanCurve
+{
+public:
+    typedef uint8_t (*Lookup_t)(const int16_t raw);
+
+    FanCurve(Lookup_t lookup, const int16_t hysteresisRaw, const unsigned long dwellMs) :
+        _lookup(lookup),
+        _hysteresis(hysteresisRaw),
+        _dwellMs(dwellMs) {};
+
+    uint8_t update(const int16_t raw, const unsigned long nowMs);
+
+private:
+    Lookup_t      _lookup;
+    int16_t       _hysteresis;  // 1/16 C
+    unsigned long _dwellMs;     // min time between reductions
+
+    uint8_t       _duty = 0;
+    unsigned long _changedMs = 0;
+    bool          _primed = false;
+};
+
+#endif
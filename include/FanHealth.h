@@ -0,0 +1,72 @@
+#ifndef __FAN_HEALTH_H
+#define __FAN_HEALTH_H
+
+#include <Arduino.h>
+#include "FanControl.h"
+#include "EepromLayout.h"
+#include "RackTopology.h"
+
+#define HEALTH_REF_DUTIES 3     // reference duty points per fan
+
+static_assert(FAN_COUNT <= MAX_FANS, "EEPROM fan health block holds MAX_FANS");
+
+/**
+ * Predictive bearing health per fan. At each reference duty the rpm,
+ * as 0.1% of that expected, is averaged over a day and folded into a
+ * weekly average held in EEPROM. The first week becomes the baseline,
+ * so later drift is measured against the fan as new. Tach period
+ * jitter is averaged in RAM. Both feed a 0-100 score, 100 as new.
+ */
+class FanHealth
+{
+public:
+    // load reference rpms from EEPROM, clearing them if not ours
+    void begin();
+
+    // per cycle for a running fan at applied duty %
+    void sample(const uint8_t fanid, const uint8_t duty, const uint16_t ratioPm, const uint16_t jitterPm);
+
+    // folds the day into EEPROM daily, true as scores refresh hourly
+    bool maintain(const unsigned long nowMs);
+
+    uint8_t getScore(const uint8_t fanid) const;
+
+    // worst rpm loss at a reference duty against baseline, 0.1%
+    int16_t getDrift(const uint8_t fanid) const;
+
+    uint16_t getJitter(const uint8_t fanid) const;
+
+private:
+    typedef struct {
+        uint16_t baselinePm;    // first week, 0 until set
+        uint16_t currentPm;     // weekly average
+        uint8_t  days;          // days folded in, saturates
+    } Ref_t;
+
+    int address(const uint8_t fan, const uint8_t ref) const {
+        return EEPROM_FANHEALTH_ADDR + 2 + (fan * HEALTH_REF_DUTIES + ref) * sizeof(Ref_t);
+    };
+
+    void score();
+
+    Ref_t         _refs[FAN_COUNT][HEALTH_REF_DUTIES];
+    uint32_t      _daySum[FAN_COUNT][HEALTH_REF_DUTIES] = {};
+    uint16_t      _dayCount[FAN_COUNT][HEALTH_REF_DUTIES] = {};
+    uint32_t      _jitterQ4[FAN_COUNT] = { 0 };  // 0.1% << 4
+    uint8_t       _score[FAN_COUNT] = { 0 };
+    unsigned long _dayMs = 0;
+    unsigned long _scoreMs = 0;
+    bool          _loaded = false;
+    bool          _scored = false;  // first maintain() refreshes
+
+    const uint8_t  _refDuty[HEALTH_REF_DUTIES] = { 40, 70, 100 };
+    const uint8_t  _refBand        = 3;     // duty % either side of a reference
+    const uint8_t  _baselineDays   = 7;
+    const uint16_t _minDaySamples  = 100;   // fewer and the day is skipped
+    const int16_t  _driftAllowPm   = 20;    // rpm loss before scoring down
+    const uint16_t _jitterAllowPm  = 20;    // jitter before scoring down
+    const unsigned long _dayPeriodMs   = 86400000;
+    const unsigned long _scorePeriodMs = 3600000;
+};
+
+#endif
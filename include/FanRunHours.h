@@ -0,0 +1,43 @@
+#ifndef __FAN_RUN_HOURS_H
+#define __FAN_RUN_HOURS_H
+
+#include <Arduino.h>
+#include "FanControl.h"
+#include "EepromLayout.h"
+#include "RackTopology.h"
+
+static_assert(FAN_COUNT <= MAX_FANS, "EEPROM run hours block holds MAX_FANS");
+
+/**
+ * Per fan running time, for wear levelling parked fans.
+ * Counted in RAM and flushed to EEPROM hourly, ~9k writes a
+ * year per counter against 100k endurance.
+ */
+class FanRunHours
+{
+public:
+    // load counters from EEPROM, clearing them if not ours
+    void begin();
+
+    // add running time for fanid (1 based)
+    void accumulate(const uint8_t fanid, const unsigned long ms);
+
+    // flush to EEPROM if due
+    void maintain(const unsigned long nowMs);
+
+    uint32_t getMinutes(const uint8_t fanid) const;
+
+private:
+    int address(const uint8_t fanid) const {
+        return EEPROM_RUNHOURS_ADDR + 2 + (fanid-1) * sizeof(uint32_t);
+    };
+
+    uint32_t      _minutes[FAN_COUNT] = { 0 };
+    uint32_t      _partialMs[FAN_COUNT] = { 0 };   // not yet a whole minute
+    unsigned long _flushMs = 0;
+    bool          _loaded = false;
+
+    const unsigned long _flushPeriodMs = 3600000;
+};
+
+#endif
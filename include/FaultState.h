@@ -0,0 +1,113 @@
+#ifndef __FAULT_STATE_H
+#define __FAULT_STATE_H
+
+#include <Arduino.h>
+#include "ErrCodes.h"
+
+/**
+ * Debounced device health. A bad sample makes a device suspect, a run
+ * of them faults it; once faulted a run of good samples is needed to
+ * clear it. Reporting on transitions only keeps one bad read from
+ * reaching the display or MQTT.
+ *
+ *   OK -> SUSPECT -> FAULTED -> RECOVERING -> OK
+ *           |  ^                   |
+ *           v  |                   v
+ *            OK                 FAULTED
+ */
+enum FaultState_t {
+    FAULT_OK,
+    FAULT_SUSPECT,
+    FAULT_FAULTED,
+    FAULT_RECOVERING
+};
+
+typedef struct {
+    uint8_t faultAfter;     // consecutive bad samples to fault
+    uint8_t clearAfter;     // consecutive good samples to clear a fault
+} FaultThresholds_t;
+
+typedef struct {
+    FaultState_t state;
+    uint8_t      run;       // consecutive samples towards the next state
+    RESULT       lastError;
+    uint16_t     errors;    // bad samples since boot
+    uint16_t     faults;    // times faulted since boot
+} Fault_t;
+
+inline bool isFaulted(const Fault_t& f) {
+    return f.state == FAULT_FAULTED || f.state == FAULT_RECOVERING;
+}
+
+inline const char* faultStateName(const FaultState_t s) {
+    switch (s) {
+        case FAULT_SUSPECT:    return "suspect";
+        case FAULT_FAULTED:    return "faulted";
+        case FAULT_RECOVERING: return "recovering";
+        default:               return "ok";
+    }
+}
+
+// straight to faulted on conclusive evidence, true on transition
+inline bool faultTrip(Fault_t& f, const RESULT r) {
+    f.errors++;
+    f.lastError = r;
+    f.run = 0;
+    if (f.state == FAULT_FAULTED)
+        return false;
+    f.state = FAULT_FAULTED;
+    f.faults++;
+    return true;
+}
+
+// one sample, true on transition
+inline bool faultUpdate(Fault_t& f, const RESULT r, const FaultThresholds_t& t) {
+
+    FaultState_t prev = f.state;
+    if (r != RES_OK) {
+        f.errors++;
+        f.lastError = r;
+        switch (f.state) {
+            case FAULT_OK:
+            case FAULT_SUSPECT:
+                if (f.state == FAULT_OK)
+                    f.run = 0;
+                f.state = FAULT_SUSPECT;
+                if (++f.run >= t.faultAfter) {
+                    f.state = FAULT_FAULTED;
+                    f.faults++;
+                    f.run = 0;
+                }
+                break;
+            case FAULT_RECOVERING:
+                f.state = FAULT_FAULTED;
+                f.run = 0;
+                break;
+            default:
+                break;
+        }
+    }
+    else {
+        switch (f.state) {
+            case FAULT_SUSPECT:
+                f.state = FAULT_OK;
+                f.run = 0;
+                break;
+            case FAULT_FAULTED:
+            case FAULT_RECOVERING:
+                if (f.state == FAULT_FAULTED)
+                    f.run = 0;
+                f.state = FAULT_RECOVERING;
+                if (++f.run >= t.clearAfter) {
+                    f.state = FAULT_OK;
+                    f.run = 0;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    return f.state != prev;
+}
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef __HISTORY_STORE_H
+#define __HISTORY_STORE_H
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <stdint.h>     // host round-trip test, see test/test_history
+#include <string.h>
+#endif
+
+#define HISTORY_CHANNELS     8      // values per record
+#define HISTORY_BLOCKS       12
+#define HISTORY_BLOCK_BYTES  128    // 1.5 KB in total
+
+typedef struct {
+    uint32_t t;                     // seconds, unix time once the clock syncs
+    int16_t  v[HISTORY_CHANNELS];   // raw temps, rpms
+} HistoryRecord_t;
+
+/**
+ * Compressed in RAM history, a ring of fixed size blocks each holding
+ * a bit packed record stream. The first record of a block is stored in
+ * full so blocks decode independently and the oldest can be dropped.
+ * Later records store the timestamp as a delta of delta and each value
+ * as a zigzag delta, in variable length buckets:
+ *
+ *   time   0 | 10 +4 bits | 110 +8 bits | 111 +32 bits
+ *   value  0 | 10 +3 bits | 110 +6 bits | 1110 +10 bits | 1111 +16 bits
+ *
+ * At a steady period a temp that has not changed costs one bit, so a
+ * record of 2 temps and 4 rpms is typically 3-5 bytes against 16 raw.
+ */
+class HistoryStore
+{
+public:
+    // number of channels per record, clears the store if changed
+    void begin(const uint8_t channels);
+
+    void append(const HistoryRecord_t& r);
+
+    uint8_t getChannels() const {
+        return _channels;
+    };
+
+    uint16_t getRecords() const;
+
+    /**
+     * Shift every timestamp by offset seconds, e.g. from uptime to unix
+     * time as the clock first syncs, so the store holds one timebase.
+     * Only key records hold a full time, deltas are unchanged.
+     */
+    void rebase(const int32_t offset);
+
+    /**
+     * Streaming decode, oldest first. Appending while reading is
+     * undefined, hold appends until the export completes.
+     */
+    class Reader
+    {
+    public:
+        Reader(const HistoryStore& store);
+        bool next(HistoryRecord_t& r);
+
+    private:
+        const HistoryStore& _store;
+        uint8_t         _block;     // blocks from oldest
+        uint16_t        _bit;
+        uint8_t         _index;     // record in block
+        HistoryRecord_t _prev;
+        int32_t         _prevDelta;
+    };
+
+private:
+    typedef struct {
+        uint16_t bits;      // used
+        uint8_t  records;
+    } BlockHeader_t;
+
+    void     putBits(uint32_t value, const uint8_t n);
+    uint32_t getBits(const uint8_t block, uint16_t& bit, const uint8_t n) const;
+    void     putValue(const int16_t delta);
+    void     startBlock();
+
+    uint8_t slot(const uint8_t fromOldest) const {
+        return (_head + HISTORY_BLOCKS + 1 - _filled + fromOldest) % HISTORY_BLOCKS;
+    };
+
+    uint8_t         _data[HISTORY_BLOCKS][HISTORY_BLOCK_BYTES];
+    BlockHeader_t   _headers[HISTORY_BLOCKS];
+    uint8_t         _head = 0;      // block being written
+    uint8_t         _filled = 0;    // blocks holding records
+    uint8_t         _channels = 0;
+    HistoryRecord_t _prev;
+    int32_t         _prevDelta = 0;
+
+    // worst case record, sized to start a new block before overflow:
+    // a 3+32 bit time delta and 4+16 bits per value
+    uint16_t maxRecordBits() const {
+        return 35 + 20 * _channels;
+    };
+};
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef __LOG_RING_H
+#define __LOG_RING_H
+
+#include <Arduino.h>
+
+#define LOG_RING_SIZE 512   // bytes, power of 2
+
+/**
+ * Fixed ring of log output, so any task can log without the heap or
+ * the network. One task drains it into the real output, e.g. the MQTT
+ * log. Writers must be serialised by the caller (one line at a time),
+ * and the single reader only sees completed lines.
+ *
+ * Sized for the worst burst logged in one control cycle, before the
+ * network task gets to run: a total fan failure is a stall and a fault
+ * line per fan plus the degraded line, about 9 lines of 45 bytes. A
+ * line that does not fit is dropped whole, and counted.
+ */
+class LogRing : public Print
+{
+public:
+    size_t write(uint8_t c) {
+        if (_overflow) {
+            // rest of a dropped line
+            _overflow = (c != '\n');
+            return 0;
+        }
+
+        uint16_t next = (_head + 1) & (LOG_RING_SIZE - 1);
+        if (next == load(_tail)) {
+            // back out the partial line
+            _head = _committed;
+            _overflow = (c != '\n');
+            _dropped++;
+            return 0;
+        }
+        _buf[_head] = c;
+        _head = next;
+        if (c == '\n')
+            store(_committed, _head);
+        return 1;
+    };
+
+    // drain completed lines into out, returns bytes moved
+    uint16_t drain(Print& out) {
+        uint16_t end = load(_committed);
+        uint16_t tail = _tail;
+        uint16_t n = 0;
+        while (tail != end) {
+            out.write(_buf[tail]);
+            tail = (tail + 1) & (LOG_RING_SIZE - 1);
+            store(_tail, tail);
+            n++;
+        }
+        return n;
+    };
+
+    // lines lost to a full ring
+    uint16_t getDropped() const {
+        return _dropped;
+    };
+
+private:
+    // indices are shared between tasks, and 16 bit loads are not atomic on AVR
+    static uint16_t load(const volatile uint16_t& i) {
+        noInterrupts();
+        uint16_t v = i;
+        interrupts();
+        return v;
+    };
+
+    static void store(volatile uint16_t& i, const uint16_t v) {
+        noInterrupts();
+        i = v;
+        interrupts();
+    };
+
+    char              _buf[LOG_RING_SIZE];
+    uint16_t          _head = 0;        // next write, writer only
+    volatile uint16_t _committed = 0;   // end of the last completed line
+    volatile uint16_t _tail = 0;        // next read
+    bool              _overflow = false; // dropping to the end of the line
+    uint16_t          _dropped = 0;
+};
+
+#endif
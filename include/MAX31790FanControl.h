@@ -72,6 +72,7 @@ public:
     virtual RESULT initialise();    
     virtual RESULT setPWMForAll(const uint16_t dutyCycle);
     virtual RESULT setPWM(const uint8_t fanid, const uint16_t dutyCycle);
+    virtual RESULT setPWMs(const uint8_t* dutyCycles);
     virtual RESULT getTachCount(const uint8_t fanid, uint16_t& tachCount);
 
     virtual RESULT getTachHz(const uint8_t fanid, uint16_t& tachHz);
@@ -17,17 +17,44 @@ public:
 
     int initialise();
 
-    void publish(RackState_t& rs);
+    // anomalies are not in the view, publish them separately
+    void publish(const RackView_t& rs);
+
+    // one summary record per channel as each statistics interval closes
+    void publishStats(const RackView_t& rs);
+
+    // device fault states on transitions
+    void publishFaults(const RackView_t& rs);
+
+    // fan health as scores refresh
+    void publishHealth(const RackView_t& rs);
+
+    // one event, as queued by the control task
+    void publishAnomaly(const AnomalyEvent_t& event);
+
+    // task stack high-water mark
+    void publishStack(const char* task, const uint16_t freeBytes);
 
     void poll();
 
+    // decode the controller's history to device/rack/history, oldest first
+    void publishHistory(const HistoryStore& history, const RackView_t& rs);
+
+    bool isHistoryRequest(const String& topic) const;
+
+    // load hint topic is device/rack/loadhint/<source>
+    bool isLoadHintTopic(const String& topic, String& source) const;
+    RESULT parseLoadHint(const char* payload, uint8_t& level, unsigned long& ttlMs) const;
+
     /**
      * From Print.h
      */
     size_t write(uint8_t c);
     
 private:
-    void sendMessage(const String& topic, const String& msg);
+    // topics are PROGMEM, see MqttManager.cpp
+    int beginMessage(const char* topic);
+    void sendMessage(const char* topic, const String& msg);
 
     MqttClient* _p_mqttClient;
 
@@ -36,18 +63,12 @@ private:
     const uint16_t _port;       // mqtt server port
     String         _buf;        // log buffer
 
-    const String topicTempRackTop  = "device/temp/rack/top";
-    const String topicTempRackBase = "device/temp/rack/base";
-    const String topicTempRackAve  = "device/temp/rack/average";
-    
-    const String topicFanTopLeft   = "device/rack/fan/topleft";
-    const String topicFanTopRight  = "device/rack/fan/topright";
-    const String topicFanBaseLeft  = "device/rack/fan/baseleft";
-    const String topicFanBaseRight = "device/rack/fan/baseright";
+    const uint16_t _loadHintFullWatts = 400;    // watts hint equal to level 100
 
-    const String topicConfig      = "device/rack/config";  //display on/off subscriber topic 
+    uint16_t _statsSeq = 0;     // last interval published
+    uint16_t _healthSeq = 0;    // last health scores published
+    uint16_t _faultSeq = 0;     // last fault states published
+    bool     _faultsPublished = false;
 
-    const String topicRackLog     = "device/rack/log";
-    const String subtopicFanError = "/error";
-    const String subtopicFanRPM   = "/rpm";
+    const uint16_t _historyChunk  = 200;    // bytes per history message
 };
@@ -35,20 +35,21 @@ public:
     void initialise();
 
     void render(const String& s);
-    void render(RackState_t& rs, const NetworkState_t& ns); // std::map implementation does not support const
+    void render(const RackView_t& rs, const NetworkState_t& ns);
     void clearDisplay();
     void displayOff();
     void displayOn();
     void setOrientation(OLED_Orientation orient);   // rotate
 
 protected:
-    void internalRender(RackState_t&rs, const NetworkState_t& ns);
-    void drawFloat2_1DP(int x, int y, float f);
+    void internalRender(const RackView_t& rs, const NetworkState_t& ns);
+    void drawTemp1DP(int x, int y, int16_t raw);
     void drawPercentage(int x, int y, uint8_t pc);
-    void drawTempErrStates(const Thermos_t& thermos, int x, int y);
-    void drawFanErrStates(const Fans_t& fans, int x, int y);
+    void drawTempErrStates(const RackView_t& rs, int x, int y);
+    void drawFanErrStates(const RackView_t& rs, int x, int y);
     void drawNetworkState(const NetworkState_t& ns, int x, int y);
-    uint8_t getPercentageRPM(const FanState_t& fan) const;
+    uint8_t getPercentageRPM(const FanView_t& fan) const;
+    OLED_Colour getFaultColour(const Fault_t& fault) const;
 
 private:
     int getDigits(uint16_t n, uint8_t* pBuf) const;
@@ -63,6 +64,8 @@ private:
     bool    _usingIRSensor;
     uint8_t _IRPin;
     bool    _firstDisplay = true;
+    bool    _faultsDrawn = false;
+    uint16_t _faultSeq = 0;     // last rs.faultSeq drawn
     int     _l = 0;
 
     typedef union _IPAddress {
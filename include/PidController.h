@@ -0,0 +1,61 @@
+#ifndef __PID_CONTROLLER_H
+#define __PID_CONTROLLER_H
+
+#include <Arduino.h>
+#include "TempRaw.h"
+
+/**
+ * Discrete fixed-point PID for fan duty.
+ * Input and setpoint are raw temps (1/16 C); output is duty %.
+ * Error is measurement - setpoint so a hotter rack drives more duty.
+ *
+ * Gains are Q8.8:
+ *   kp - duty % per C
+ *   ki - duty % per C per second
+ *   kd - duty % per C/s
+ *
+ * - dt is taken from the timestamps passed to update()
+ * - anti-windup by conditional integration and integrator clamping
+ * - derivative is on measurement (no setpoint kick) and low pass
+ *   filtered with alpha = 1/2^dShift
+ */
+class PidController
+{
+public:
+    PidController(const int16_t kp, const int16_t ki, const int16_t kd, const uint8_t dShift = 2) :
+        _kp(kp), _ki(ki), _kd(kd), _dShift(dShift) {};
+
+    uint8_t update(const int16_t measRaw, const unsigned long nowMs);
+    void reset();
+
+    void setSetpoint(const int16_t raw) {
+        _setpoint = raw;
+    };
+
+    int16_t getSetpoint() const {
+        return _setpoint;
+    };
+
+    void setOutputLimits(const uint8_t minDuty, const uint8_t maxDuty);
+
+private:
+    int16_t _kp;
+    int16_t _ki;
+    int16_t _kd;
+    uint8_t _dShift;
+
+    int16_t _setpoint = TEMP_RAW(22);
+    int32_t _outMin   = 0;          // Q8 duty %
+    int32_t _outMax   = 100L << 8;  // Q8 duty %
+
+    int32_t _integ    = 0;          // Q8 duty %
+    int32_t _dFilt    = 0;          // filtered dT/dt, 1/256 C per s
+    int16_t _prevMeas = 0;
+    unsigned long _prevMs = 0;
+    bool    _primed   = false;      // false until first sample taken
+
+    const int16_t _maxErr = 40*16;  // clamp on |error| to bound products
+    const unsigned long _maxDtMs = 10000;
+};
+
+#endif
@@ -5,35 +5,238 @@
 #include <Wire.h>
 #include <Ethernet.h>
 #include <DallasTemperature.h>
-#include <ArduinoSTL.h>
-#include <list>
-#include <map>
 #include "FanControl.h"
+#include "RackTopology.h"
+#include "TempRaw.h"
+#include "Ewma.h"
+#include "FaultState.h"
+#include "PidController.h"
+#include "FanCurve.h"
+#include "ThermalModel.h"
+#include "ThermalProfile.h"
+#include "SntpClock.h"
+#include "FanRunHours.h"
+#include "TrendBuffer.h"
+#include "StreamStats.h"
+#include "HistoryStore.h"
+#include "AnomalyDetector.h"
+#include "FanHealth.h"
+
+#define TEMP_FILTER_DEPTH 5   // samples held per thermo for outlier rejection
+
+#define MAX_THERMOS      THERMO_COUNT   // rack state capacity, sized by RackTopology.h
+#define MAX_ZONES        ZONE_COUNT
+#define MAX_ZONE_THERMOS 4
+#define MAX_ZONE_FANS    4
+
+// per fan state is sized by FAN_COUNT, FanControl batches up to MAX_FANS
+static_assert(FAN_COUNT <= MAX_FANS, "more fans than FanControl supports");
+
+#define RACK_ZONE_SIZE(id, name, aggregate, thermos, weights, fans) \
+    static_assert(rackCount thermos == rackCount weights, "zone " name " needs a weight per thermo"); \
+    static_assert(rackCount thermos <= MAX_ZONE_THERMOS, "zone " name " has too many thermos"); \
+    static_assert(rackCount fans <= MAX_ZONE_FANS, "zone " name " has too many fans");
+RACK_ZONES(RACK_ZONE_SIZE)
+
+// device and zone names are held in PROGMEM, print with %S
+#define FNAME(p) (reinterpret_cast<const __FlashStringHelper*>(p))
 
 typedef struct {
-    DeviceAddress addr;        // address for DS*
-    float         tempCelsuis; // temp in C
-    RESULT        result;      // reading outcome
+    uint16_t crcErrors;     // scratchpad reads failing CRC
+    uint16_t retries;       // scratchpad re-reads issued
+    uint16_t rejected;      // samples rejected as outliers
+} TempCounters_t;
+
+typedef struct {
+    const char*    name;        // PROGMEM
+    DeviceAddress  addr;        // address for DS*
+    int16_t        tempRaw;     // temp in 1/16 C
+    RESULT         result;      // reading outcome
+    int16_t        window[TEMP_FILTER_DEPTH]; // recent raw samples (1/16 C)
+    uint8_t        samples;     // number of valid entries in window
+    uint8_t        next;        // next window slot to overwrite
+    TempCounters_t counters;
+    bool           alarm;       // outside TH/TL band at last conversion
+    Ewma_t         trend;       // time weighted average and slope
+    Fault_t        fault;       // debounced from result
 } Temperature_t;
 
 typedef struct {
-    String   position;  // TL, TR etc
+    const char* position;   // TL, TR etc, PROGMEM
     uint8_t  pwm;       // % of dutycycle
     uint16_t rpm;       // tach count
     uint16_t minRpm;    // minRpm may be >0
     uint16_t maxRpm;
-    RESULT   result;    // state: OK, not operational, etc
+    RESULT   result;    // state: OK, not operational, etc - this cycle
+    uint8_t  minDuty;   // control output clamp, % - keep rpm above minRpm
+    uint8_t  maxDuty;
+    unsigned long lastKickMs;   // last spin-up retry while not operational
+    uint16_t idleMw;    // estimated draw at minimum spin
+    uint16_t maxMw;     // estimated draw at 100% duty
+    bool     parked;    // stopped under low load, tach expected ~0
+    int16_t  trim;      // rpm loop duty offset, 1/16 %
+    uint16_t jitter;    // tach period jitter, 0.1%
+    uint8_t  health;    // bearing health score, 100 as new
+    int16_t  drift;     // rpm loss against new, 0.1%
+    Fault_t  fault;     // debounced from result
+    bool     spinUp;    // pwm raised from 0, rpm not yet judged
+    unsigned long spinUpMs;     // when pwm was raised from 0
 } FanState_t;
 
-typedef std::map <String, Temperature_t> Thermos_t;
-typedef std::map <uint8_t, FanState_t>   Fans_t;
+/**
+ * How a zone combines its thermos into one control input.
+ */
+enum ZoneAggregate_t {
+    AGG_MAX,            // hottest thermo
+    AGG_WEIGHTED_MEAN   // mean weighted by Zone_t::weights
+};
+
+/**
+ * A zone maps thermos to the fans they govern. A fan in more
+ * than one zone runs at the highest duty demanded of it.
+ */
+typedef struct {
+    const char*     name;                       // PROGMEM
+    uint8_t         thermos[MAX_ZONE_THERMOS];  // input thermo ids
+    uint8_t         weights[MAX_ZONE_THERMOS];  // per thermo, AGG_WEIGHTED_MEAN only
+    uint8_t         thermoCount;
+    uint8_t         fans[MAX_ZONE_FANS];        // output fan ids
+    uint8_t         fanCount;
+    ZoneAggregate_t aggregate;
+    int16_t         tempRaw;    // aggregated input, 1/16 C
+    int16_t         aveTempRaw; // moving average of tempRaw
+    int16_t         riseRaw;    // rise across the trend window
+    uint8_t         duty;       // control output %
+    RESULT          result;     // RES_OK if any input was readable
+    Ewma_t          trend;      // time weighted average and slope of tempRaw
+} Zone_t;
 
+#define STATS_THERMOS MAX_THERMOS   // thermos summarised per interval, by thermo id
+#define STATS_FANS    FAN_COUNT     // fan duties summarised, by fanid - 1
+
+typedef StreamStats<50, TEMP_RAW(10), 16> TempStats_t;  // 1 C bins, 10 to 60 C
+typedef StreamStats<21, 0, 5>             DutyStats_t;  // 5% bins
+
+/**
+ * Per interval summaries, replaced as each interval closes.
+ */
 typedef struct {
-    Thermos_t thermos;
-    float     aveTempCelsius; 
-    Fans_t    fans;
+    uint16_t       seq;                     // increments as each interval closes
+    StatsSummary_t thermos[STATS_THERMOS];  // 1/16 C
+    StatsSummary_t duty[STATS_FANS];        // %, fanid 1 is [0]
+} IntervalStats_t;
+
+#define MAX_ANOMALY_EVENTS 4
+
+typedef struct {
+    const char*   signal;       // thermo name or fan position, PROGMEM
+    bool          fan;          // magnitude units: fan 0.1% of expected rpm, else 1/16 C
+    AnomalyKind_t kind;
+    int16_t       magnitude;    // deviation from baseline
+    uint32_t      onset;        // seconds, unix time once the clock syncs
+} AnomalyEvent_t;
+
+/**
+ * Whole rack state, plain data in fixed arrays so nothing is allocated
+ * per cycle. Built once by the factory methods and persisted across
+ * cycles for filtering and trends.
+ */
+typedef struct {
+    Temperature_t thermos[MAX_THERMOS]; // by thermo id
+    uint8_t   thermoCount;
+    int16_t   aveTempRaw;       // mean of thermo time weighted averages, 1/16 C
+    int16_t   riseRaw;          // rise across the trend window, 1/16 C
+    FanState_t fans[FAN_COUNT]; // fanid 1 is [0]
+    uint8_t   fanCount;
+    Zone_t    zones[MAX_ZONES]; // by zone id, also the profile and trend index
+    uint8_t   zoneCount;
+    bool      degraded;         // a fan is not operational, cooling compensated
+    uint8_t   loadHint;         // summed unexpired host load hints, 0-100
+    uint8_t   powerUtil;        // estimated draw as % of PoE budget
+    IntervalStats_t stats;      // last closed statistics interval
+    AnomalyEvent_t  anomalies[MAX_ANOMALY_EVENTS];  // raised, not yet published
+    uint8_t         anomalyCount;
+    uint16_t        healthSeq;  // increments as fan health scores refresh
+    uint16_t        faultSeq;   // increments on any fault state transition
 } RackState_t;
 
+/**
+ * One tach window's readings, handed from sampleTach() to updateTach().
+ */
+typedef struct {
+    uint16_t rpm[FAN_COUNT];    // fanid 1 is [0]
+    uint16_t jitter[FAN_COUNT]; // tach period jitter, 0.1%
+} TachSample_t;
+
+/**
+ * What the display and network need of the rack state. Copied out of
+ * the state by buildView(), so those tasks neither hold the state lock
+ * while they draw or publish nor keep a copy of filter and control
+ * internals they never read.
+ */
+typedef struct {
+    const char* name;       // PROGMEM
+    int16_t     tempRaw;    // 1/16 C
+    Ewma_t      trend;
+    Fault_t     fault;
+} ThermoView_t;
+
+typedef struct {
+    const char* position;   // PROGMEM
+    uint16_t    rpm;
+    uint16_t    minRpm;
+    uint16_t    maxRpm;
+    uint8_t     health;     // bearing health score, 100 as new
+    int16_t     drift;      // rpm loss against new, 0.1%
+    uint16_t    jitter;     // tach period jitter, 0.1%
+    Fault_t     fault;
+} FanView_t;
+
+typedef struct {
+    ThermoView_t    thermos[MAX_THERMOS];   // by thermo id
+    uint8_t         thermoCount;
+    int16_t         aveTempRaw;             // 1/16 C
+    FanView_t       fans[FAN_COUNT];        // fanid 1 is [0]
+    uint8_t         fanCount;
+    Ewma_t          zoneTrends[MAX_ZONES];  // by zone id
+    uint8_t         zoneCount;
+    bool            degraded;
+    uint8_t         powerUtil;
+    IntervalStats_t stats;
+    uint16_t        healthSeq;
+    uint16_t        faultSeq;
+} RackView_t;
+
+#define MAX_LOAD_HINTS 4    // hosts tracked at once
+#define LOAD_HINT_SOURCE 24 // host name length, including terminator
+
+typedef struct {
+    char          source[LOAD_HINT_SOURCE]; // publishing host, empty if slot free
+    uint8_t       level;        // 0-100
+    unsigned long expiresMs;    // millis() when hint lapses
+} LoadHint_t;
+
+/**
+ * READ_ALL reads every scratchpad each cycle. READ_ALARMED programs
+ * each DS18B20's TH/TL to the control band holding its last reading
+ * and only reads those found by alarm search plus a rotating subset.
+ */
+enum TempReadMode_t {
+    READ_ALL,
+    READ_ALARMED
+};
+
+/**
+ * CONTROL_PID holds the setpoint, CONTROL_CURVE follows the
+ * compile time fan curve with hysteresis, CONTROL_MPC picks duty
+ * from each zone's identified thermal model (PID until it is valid).
+ */
+enum FanControlMode_t {
+    CONTROL_PID,
+    CONTROL_CURVE,
+    CONTROL_MPC
+};
+
 typedef struct {
     IPAddress ethernetIP;    // may change via DHCP
     String    mqttServerIP;
@@ -43,47 +246,281 @@ typedef struct {
 /**
  * Controller class for thermometers (using OneWire)
  * and fans under the interface FanControl.
- * Any number of thermos or fans can be supported as 
- * long as these are configured by factory methods:
- * build() and build_debug();
+ * Thermos, fans and zones are described at compile time in
+ * RackTopology.h, and the state built from them by build().
  */
 class RackTempController
 {    
 public:
     RackTempController(OneWire& oneWire, FanControl& fanControl) :
+        _oneWire(oneWire),
         _tempSensors(&oneWire), 
-        _fanControl(fanControl) {};
+        _fanControl(fanControl),
+        _setpoint(TEMP_RAW(22)) {};
+
+    // load persisted state, call from setup()
+    void initialise();
 
     // process temps, update PWMs, read fan tach ...
     void process(RackState_t& rackState);
 
-    // factory methods
+    // the stages of process(), in order, for running from separate tasks
+    void requestTemps(RackState_t& rackState);
+    void readTemps(RackState_t& rackState);
+    void updateFans(RackState_t& rackState);
+    void startTach();                           // opens the tach window, no rack state
+    void sampleTach(TachSample_t& sample);      // closes it after getTachWindowMs()
+    void updateTach(RackState_t& rackState, const TachSample_t& sample);
+    void updateTrends(RackState_t& rackState);
+
+    // requestTemps() returns without waiting for conversion, which
+    // then takes getConversionMs() at the current resolution
+    void setAsyncConversion(const bool async) {
+        _tempSensors.setWaitForConversion(!async);
+    };
+
+    uint16_t getConversionMs();
+
+    uint16_t getTachWindowMs() const {
+        return _tachWindowMs;
+    };
+
+    // cheap tach edge timeout check, call often between stages
+    void checkStalls(RackState_t& rackState);
+
+    // log and fault stalls found by checkStalls(), at a safe point
+    void reportStalls(RackState_t& rackState);
+
+    // factory method, from the compile time topology in RackTopology.h
     RackState_t build() const;
-    RackState_t build_debug() const;    // for testing support
+
+    // copy out the display and network view of the rack state
+    static void buildView(const RackState_t& rackState, RackView_t& view);
 
     // search for DS18* devices and print addresses
     void searchAndPrintAddresses();
+
+    void setTempReadMode(const TempReadMode_t mode) {
+        _tempReadMode = mode;
+    };
+
+    void setControlMode(const FanControlMode_t mode) {
+        _controlMode = mode;
+    };
+
+    // consecutive samples to fault and to clear, per device type
+    void setFanFaultThresholds(const uint8_t faultAfter, const uint8_t clearAfter) {
+        _fanFault.faultAfter = faultAfter;
+        _fanFault.clearAfter = clearAfter;
+    };
+
+    void setThermoFaultThresholds(const uint8_t faultAfter, const uint8_t clearAfter) {
+        _thermoFault.faultAfter = faultAfter;
+        _thermoFault.clearAfter = clearAfter;
+    };
+
+    // park redundant fans under sustained low load
+    void setParking(const bool enabled) {
+        _parkingEnabled = enabled;
+    };
+
+    // trim each fan's duty from its tach so rpm tracks its minRpm..maxRpm line
+    void setRpmTrim(const bool enabled) {
+        _rpmTrimEnabled = enabled;
+    };
+
+    // compressed history, thermos by id then fan rpms
+    const HistoryStore& getHistory() const {
+        return _history;
+    };
+
+    // hold history appends while it is exported from another task
+    void setHistoryPaused(const bool paused) {
+        _historyPaused = paused;
+    };
+
+    // duty multiplier, %, for fans sharing a zone with a failed fan
+    void setFailBoost(const uint8_t pc) {
+        _failBoostPc = pc;
+    };
+
+    // expected load from a host, feed-forward onto fan duty until ttl lapses
+    void setLoadHint(const char* source, const uint8_t level, const unsigned long ttlMs);
+
+    // wall clock for the learned time of day profile
+    void setClock(SntpClock* clock) {
+        _clock = clock;
+        _profile.begin();
+    };
+
+    // PoE supply available and draw of everything but the fans, mW
+    void setPowerBudget(const uint16_t budgetMw, const uint16_t baseLoadMw) {
+        _powerBudgetMw = budgetMw;
+        _baseLoadMw = baseLoadMw;
+    };
+
+    // rack temperature to hold, raw 1/16 C
+    void setSetpoint(const int16_t raw) {
+        _setpoint = raw;
+    };
   
 protected:
-    void readFanSpeeds(Fans_t& fs);
-    void readTempStates(Thermos_t& ts);
+    void readTempStates(RackState_t& rs);
     void adjustFanSpeeds(RackState_t& rs);
-    void verifyFanStates(Fans_t& fs) const;
+    uint8_t verifyFanStates(RackState_t& rs);
     void analyseTrends(RackState_t& rs) /* const */;
 
     void printAddress(const DeviceAddress deviceAddress) const;
 
+    void readAlarmedTempStates(RackState_t& rs);
+    void readThermo(Temperature_t& thermo, uint8_t& retries);
+    RESULT readRawTemp(Temperature_t& thermo, int16_t& raw, uint8_t& retries, ScratchPad& sp);
+    void armAlarm(const Temperature_t& thermo, const ScratchPad& sp, const int16_t raw);
+    bool filterRawTemp(Temperature_t& thermo, int16_t& raw) const;
+    int16_t medianRaw(const int16_t* samples, const uint8_t n) const;
+
 private:
+    OneWire&           _oneWire;      // for scratchpad writes without EEPROM copy
     DallasTemperature  _tempSensors;
     FanControl&        _fanControl;   // fan control implementation
+    int16_t            _setpoint;     // raw 1/16 C
+    FanControlMode_t   _controlMode = CONTROL_PID;
+
+    // control state per zone
+    struct ZoneControl_t {
+        ZoneControl_t() :
+            pid(_KP, _KI, _KD),
+            curve(rackCurveLookup, TEMP_RAW(1), 60000),
+            parkStartRaw(0),
+            modelled(false) {};
+
+        PidController pid;
+        FanCurve      curve;
+        ThermalModel  model;    // identified every cycle, used by CONTROL_MPC
+        int16_t       parkStartRaw; // zone temp when fans were parked
+        bool          modelled; // last duty chosen by the model, pid idle
+    };
+    ZoneControl_t _zoneControl[MAX_ZONES];  // by zone id
+
+    static uint8_t rackCurveLookup(const int16_t raw);
+
+    TrendBuffer   _trend;                   // last TREND_DEPTH cycles
+    const unsigned long _ewmaTauMs = 120000; // time constant of per sensor/zone averages
+
+    // compressed history for back-fill after a broker outage
+    HistoryStore  _history;
+    unsigned long _historyMs = 0;
+    bool          _historyPaused = false;
+    bool          _historyUnix = false;     // timestamps are unix time, else uptime
+    const unsigned long _historyPeriodMs = 60000;   // ~6 hours held
+
+    FanHealth     _health;
+
+    // debounced faults
+    FaultThresholds_t _fanFault    = { 3, 5 };
+    FaultThresholds_t _thermoFault = { 3, 5 };
+    uint16_t      _faultSeq = 0;
+
+    // tach edge stall detection
+    uint8_t       _stallPending = 0;        // fanid 1 is bit 0, awaiting reportStalls()
+    uint16_t      _stallAgeMs[FAN_COUNT] = {};   // tach edge age at detection
+    unsigned long _stallCheckMs = 0;
+    const uint8_t _stallCheckPeriodMs = 20;
+    const uint8_t _stallMarginMs      = 100;    // past the expected edge
+
+    // anomaly detection per thermo and fan rpm
+    AnomalyDetector _thermoAnomaly[STATS_THERMOS];
+    AnomalyDetector _fanAnomaly[FAN_COUNT];
+    const uint8_t _thermoMinSd = 2;     // 1/16 C, above quantisation
+    const uint8_t _fanMinSd    = 15;    // 0.1%, ~30rpm tach resolution
+
+    // streaming statistics for capacity planning
+    TempStats_t   _thermoStats[STATS_THERMOS];
+    DutyStats_t   _dutyStats[STATS_FANS];
+    unsigned long _statsStartMs = 0;
+    const unsigned long _statsIntervalMs = 3600000;
+    const uint8_t _rpmVariance    = 10;    // variance on maxRpm as %
+    SntpClock*     _clock = NULL;
+    ThermalProfile _profile;                // typical rise by time of day per zone
+    const uint8_t _profileLookahead = 2;    // buckets ahead to pre-cool for
+    const int8_t  _profileMinRise  = 8;     // rise worth pre-cooling for, 1/16 C
+    const uint8_t _profileGain     = 2;     // duty % per 1/16 C expected rise
+
+    uint16_t      _powerBudgetMw  = 12950;  // 802.3af class 0 at the PD
+    uint16_t      _baseLoadMw     = 6500;   // board, OLED, ethernet, regulator loss
+    bool          _powerLimited   = false;  // governor cut duties at last apply
+
+    // per fan rpm trim
+    bool          _rpmTrimEnabled  = false;
+    const uint8_t _rpmTrimLimit    = 15;    // duty %
+    const uint8_t _rpmTrimGain     = 8;     // 1/16 duty % per 1% rpm error
+    const uint8_t _rpmTrimDeadband = 40;    // rpm, above 30rpm tach resolution
+
+    // low load fan parking
+    enum ParkState_t {
+        PARK_IDLE,          // all fans driven
+        PARK_TRIAL,         // parked, verifying zones hold temperature
+        PARK_COMMITTED      // parked, rotated by run hours
+    };
+    bool          _parkingEnabled = false;
+    ParkState_t   _parkState      = PARK_IDLE;
+    unsigned long _lowLoadSinceMs = 0;
+    unsigned long _parkStateMs    = 0;      // entered current park state
+    unsigned long _parkRetryAtMs  = 0;      // backoff after a failed trial
+    FanRunHours   _runHours;
+    unsigned long _lastAdjustMs   = 0;
+    const uint8_t _parkMargin     = 5;          // duty % above min still counted low load
+    const int16_t _parkMaxRise    = 8;          // zone rise that fails a trial, 1/16 C
+    const unsigned long _parkAfterMs   = 1800000;   // low load needed before parking
+    const unsigned long _parkTrialMs   = 600000;
+    const unsigned long _parkRotateMs  = 21600000;  // re-pick parked fans by run hours
+    const unsigned long _parkBackoffMs = 7200000;
+
+    LoadHint_t    _loadHints[MAX_LOAD_HINTS] = {};
+    const uint8_t _loadFeedForward = 40;   // duty % added at full load hint
+
+    uint8_t       _failBoostPc    = 140;   // surviving fan duty when a zone fan fails, %
+    const unsigned long _kickIntervalMs = 60000; // spin-up retry period for failed fans
+    const unsigned long _spinUpGraceMs = 5000;   // from pwm leaving 0 until rpm is judged
+    const uint16_t _tachWindowMs = 750;    // tach edges counted for all fans at once
+
+    static const int16_t _KP = 15*256;     // Q8.8 duty % per C
+    static const int16_t _KI = 26;         // Q8.8 duty % per C.s (~0.1)
+    static const int16_t _KD = 20*256;     // Q8.8 duty % per C/s
+    const uint8_t _tempReadRetries = 3;    // scratchpad re-reads allowed per cycle across all thermos
+    const int16_t _tempOutlierFloor = 2*16; // min deviation from median to reject (1/16 C)
 
-    std::list <RackState_t> _rsHistory;    // for trend analysis
-    const uint8_t _historyDepth   = 10;    // holds n samples in cache
-    const float   _rpmVariance    = 0.1;   // variance on maxRpm as %
-    const uint8_t _TEMP_THRESHOLD = 22;    // temp that triggers change in PWM
+    TempReadMode_t _tempReadMode = READ_ALL;
+    bool          _tempSensorsFound = false; // bus enumerated by begin()
+    uint8_t       _rotateNext     = 0;     // first thermo of next rotating read
+    const uint8_t _rotateCount    = 1;     // thermos read per cycle regardless of alarm
+    const int8_t  _alarmBandC     = 1;     // TH/TL distance from reading past the outer bands, C
 
     RESULT checkRpm(FanState_t& fs) const;
-    void cache(const RackState_t& rs);
+    void waitCheckingStalls(RackState_t& rs, const uint16_t ms);
+    uint8_t activeLoadHint();
+    void governPower(RackState_t& rs, uint8_t* duties, const bool report = true);
+    void accumulateStats(RackState_t& rs, const unsigned long now);
+    void recordHistory(RackState_t& rs, const unsigned long now);
+    void detectAnomalies(RackState_t& rs, const unsigned long now);
+    void assessFanHealth(RackState_t& rs, const unsigned long now);
+    uint16_t rpmRatio(const FanState_t& fan) const;
+    int32_t expectedRpm(const FanState_t& fan, const int32_t duty16) const;
+    void raiseAnomaly(RackState_t& rs, const char* signal, const bool fan,
+        const AnomalyKind_t kind, const AnomalyDetector& detector, const unsigned long now);
+    uint32_t timestamp(const unsigned long ms, const unsigned long now) const;
+    void trimFanSpeeds(RackState_t& rs);
+    void applyTrim(RackState_t& rs, uint8_t* duties) const;
+    void compensateStall(RackState_t& rs, const uint8_t fanid);
+    void reportFault(const char* name, const Fault_t& fault);
+    void updateParking(RackState_t& rs, const unsigned long now);
+    bool parkFans(RackState_t& rs);
+    void unparkFans(RackState_t& rs);
+    uint16_t fanPowerMw(const FanState_t& fan, const uint8_t duty) const;
+    uint32_t fanDemandMw(const RackState_t& rs, const uint8_t* duties) const;
+    uint16_t fanBudgetMw() const;
+    uint8_t profileFloor(const uint8_t z, const uint8_t minDuty, const uint8_t maxDuty) const;
+    RESULT aggregateZone(Zone_t& zone, const Temperature_t* thermos) const;
 };
 
 #endif
\ No newline at end of file
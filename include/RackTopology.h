@@ -0,0 +1,100 @@
+#ifndef __RACK_TOPOLOGY_H
+#define __RACK_TOPOLOGY_H
+
+#include <Arduino.h>
+
+/**
+ * Compile time rack topology. These lists are the only description of
+ * the rack's thermos, fans and zones. Each is expanded here into dense
+ * ids, and where used into PROGMEM tables - state in RackTempController,
+ * MQTT topics in MqttManager and layout in OLEDDisplay - so names and
+ * topics are held once, in flash, and nothing is built at runtime.
+ *
+ * THERMO(id, name, topic, label, slot, address)
+ *   name     log, history and topic name
+ *   topic    reading published to device/temp/rack/<topic>
+ *   label    OLED error box character
+ *   slot     OLED temperature position, 0 left, 1 right
+ *
+ * FAN(id, fanid, minRpm, maxRpm, minDuty, maxDuty, idleMw, maxMw, col, row)
+ *   id       position, TL, TR etc
+ *   fanid    FanControl channel, fans listed in order from 1
+ *   col, row OLED rpm % cell
+ *
+ * ZONE(id, name, aggregate, thermos, weights, fans)
+ *   thermos, weights and fans are parenthesised lists of ids
+ *
+ * Build with -DRACK_DEBUG for the single thermo and fan bench rig.
+ */
+#ifndef RACK_DEBUG
+
+#define RACK_THERMOS(THERMO) \
+    THERMO(TOP,  "topRack",  "top",  'T', 0, (0x28, 0xAA, 0x48, 0x66, 0x53, 0x14, 0x01, 0xD5)) \
+    THERMO(BASE, "baseRack", "base", 'B', 1, (0x28, 0xAA, 0x51, 0x59, 0x53, 0x14, 0x01, 0x88))
+
+#define RACK_FANS(FAN) \
+    FAN(TL, 1, 400, 1200, 40, 100, 150, 1500, 0, 0) \
+    FAN(TR, 2, 400, 1200, 40, 100, 150, 1500, 0, 1) \
+    FAN(BL, 3, 400, 1200, 40, 100, 150, 1500, 1, 0) \
+    FAN(BR, 4, 400, 1200, 40, 100, 150, 1500, 1, 1)
+
+// top exhaust fans follow the top of the rack, base intake fans
+// cool the whole rack so weight in the top thermo as well
+#define RACK_ZONES(ZONE) \
+    ZONE(TOP,  "top",  AGG_MAX,           (THERMO_TOP),              (1),    (FAN_TL, FAN_TR)) \
+    ZONE(BASE, "base", AGG_WEIGHTED_MEAN, (THERMO_BASE, THERMO_TOP), (3, 1), (FAN_BL, FAN_BR))
+
+#else
+
+#define RACK_THERMOS(THERMO) \
+    THERMO(TOP,  "topRack",  "top",  'T', 0, (0x28, 0xFF, 0xBF, 0xDC, 0x51, 0x17, 0x04, 0x48))  /* keyes */
+
+#define RACK_FANS(FAN) \
+    FAN(TL, 1, 400, 1200, 40, 100, 150, 1500, 0, 0)
+
+#define RACK_ZONES(ZONE) \
+    ZONE(RACK, "rack", AGG_MAX, (THERMO_TOP), (1), (FAN_TL))
+
+#endif
+
+#define RACK_NAME_LEN  10   // thermo, fan and zone names, including terminator
+#define RACK_TOPIC_LEN 40   // generated topics, including terminator
+
+// strip the parentheses from a list argument
+#define RACK_LIST(...) __VA_ARGS__
+
+// number of entries in a list argument, as a constant expression
+template <typename... T>
+constexpr uint8_t rackCount(T...) {
+    return sizeof...(T);
+}
+
+#define RACK_THERMO_ID(id, ...) THERMO_##id,
+#define RACK_FAN_ID(id, ...)    FAN_##id,
+#define RACK_ZONE_ID(id, ...)   ZONE_##id,
+
+// dense thermo ids, index into RackState_t::thermos
+enum ThermoId_t {
+    RACK_THERMOS(RACK_THERMO_ID)
+    THERMO_COUNT
+};
+
+// fan ids are FanControl channels, fanid 1 is RackState_t::fans[0]
+enum FanId_t {
+    FAN_NONE,
+    RACK_FANS(RACK_FAN_ID)
+    FAN_END
+};
+#define FAN_COUNT (FAN_END - 1)
+
+// dense zone ids, index into RackState_t::zones
+enum ZoneId_t {
+    RACK_ZONES(RACK_ZONE_ID)
+    ZONE_COUNT
+};
+
+#define RACK_FAN_ORDER(id, fanid, ...) \
+    static_assert(FAN_##id == fanid, "fan " #id " out of fanid order");
+RACK_FANS(RACK_FAN_ORDER)
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef __SNTP_CLOCK_H
+#define __SNTP_CLOCK_H
+
+#include <Arduino.h>
+#include <Ethernet.h>
+#include <EthernetUdp.h>
+#include "ErrCodes.h"
+
+/**
+ * Minimal SNTP client for wall clock time. Time is kept between
+ * syncs by offsetting millis() from the last server response.
+ */
+class SntpClock
+{
+public:
+    SntpClock(const char* server, const int16_t utcOffsetMin) :
+        _server(server),
+        _utcOffsetMin(utcOffsetMin) {};
+
+    RESULT sync();
+
+    // resync hourly, or every minute until first sync
+    void maintain();
+
+    bool isSynced() const {
+        return _synced;
+    };
+
+    uint32_t now() const;           // unix time, seconds UTC
+    uint16_t minuteOfDay() const;   // local time
+
+private:
+    EthernetUDP   _udp;
+    const char*   _server;
+    int16_t       _utcOffsetMin;
+
+    bool          _synced = false;
+    uint32_t      _epoch = 0;       // unix time at _syncMs
+    unsigned long _syncMs = 0;
+    unsigned long _attemptMs = 0;
+
+    const unsigned long _resyncMs  = 3600000;
+    const unsigned long _retryMs   = 60000;
+    const unsigned long _timeoutMs = 1000;
+};
+
+#endif
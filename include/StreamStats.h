@@ -0,0 +1,101 @@
+#ifndef __STREAM_STATS_H
+#define __STREAM_STATS_H
+
+#include <Arduino.h>
+
+/**
+ * Summary of one channel over a closed interval.
+ */
+typedef struct {
+    uint16_t count;     // samples, 0 if none
+    int16_t  min;
+    int16_t  max;
+    int16_t  mean;
+    int16_t  p50;
+    int16_t  p95;
+    int16_t  p99;
+} StatsSummary_t;
+
+/**
+ * Streaming min/max/mean and quantiles in constant memory. Samples are
+ * counted into BINS fixed bins of WIDTH from LO, values outside landing
+ * in the end bins; min and max are exact. Quantiles interpolate within
+ * their bin, so are accurate to a fraction of WIDTH.
+ */
+template <uint8_t BINS, int16_t LO, uint8_t WIDTH>
+class StreamStats
+{
+public:
+    StreamStats() {
+        reset();
+    };
+
+    void reset() {
+        memset(_bins, 0, sizeof(_bins));
+        _count = 0;
+        _sum = 0;
+    };
+
+    void add(const int16_t v) {
+        if (_count == 0xFFFF)
+            return;
+        if (_count == 0 || v < _min)
+            _min = v;
+        if (_count == 0 || v > _max)
+            _max = v;
+        _sum += v;
+        _count++;
+
+        int16_t b = (v < LO) ? 0 : (v - LO) / WIDTH;
+        if (b >= BINS)
+            b = BINS - 1;
+        _bins[b]++;
+    };
+
+    // value below which pc % of samples fall
+    int16_t quantile(const uint8_t pc) const {
+        if (_count == 0)
+            return 0;
+
+        uint32_t rank = ((uint32_t)_count * pc + 99) / 100;
+        if (rank == 0)
+            rank = 1;
+        uint32_t cum = 0;
+        for (uint8_t b = 0; b < BINS; b++) {
+            if (_bins[b] == 0 || cum + _bins[b] < rank) {
+                cum += _bins[b];
+                continue;
+            }
+            int32_t v = LO + (int32_t)b * WIDTH + ((int32_t)(rank - cum) * WIDTH) / _bins[b];
+            if (v < _min)
+                v = _min;
+            if (v > _max)
+                v = _max;
+            return v;
+        }
+        return _max;
+    };
+
+    void summarise(StatsSummary_t& s) const {
+        s.count = _count;
+        if (_count == 0) {
+            s.min = s.max = s.mean = s.p50 = s.p95 = s.p99 = 0;
+            return;
+        }
+        s.min  = _min;
+        s.max  = _max;
+        s.mean = (_sum + ((_sum < 0) ? -(int32_t)_count/2 : (int32_t)_count/2)) / _count;
+        s.p50  = quantile(50);
+        s.p95  = quantile(95);
+        s.p99  = quantile(99);
+    };
+
+private:
+    uint16_t _bins[BINS];
+    uint16_t _count;
+    int32_t  _sum;
+    int16_t  _min;
+    int16_t  _max;
+};
+
+#endif
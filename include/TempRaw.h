@@ -0,0 +1,34 @@
+#ifndef __TEMP_RAW_H
+#define __TEMP_RAW_H
+
+#include <Arduino.h>
+
+/**
+ * Temperatures are carried as the DS18B20 raw 12 bit reading,
+ * 1/16 C per lsb, to avoid soft-float on the AVR.
+ */
+#define TEMP_RAW_SCALE 16
+
+// compile time conversion from C, e.g. TEMP_RAW(21.5) - constants only
+#define TEMP_RAW(c) ((int16_t)((c) * TEMP_RAW_SCALE + (((c) < 0) ? -0.5 : 0.5)))
+
+/**
+ * Raw temp to tenths of a degree, rounded half away from zero.
+ */
+inline int16_t tempRawToTenths(const int16_t raw) {
+    int32_t t = (int32_t)raw * 10;
+    return (t >= 0) ? (t + TEMP_RAW_SCALE/2) / TEMP_RAW_SCALE :
+                      (t - TEMP_RAW_SCALE/2) / TEMP_RAW_SCALE;
+}
+
+/**
+ * Formats raw temp as "-dd.d" into buf, which must hold 8 chars.
+ */
+inline char* formatTempRaw(const int16_t raw, char* buf) {
+    int16_t tenths = tempRawToTenths(raw);
+    uint16_t a = (tenths < 0) ? -tenths : tenths;
+    sprintf(buf, "%s%u.%u", (tenths < 0) ? "-" : "", a / 10, a % 10);
+    return buf;
+}
+
+#endif
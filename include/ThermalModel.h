@@ -0,0 +1,63 @@
+#ifndef __THERMAL_MODEL_H
+#define __THERMAL_MODEL_H
+
+#include <Arduino.h>
+#include "TempRaw.h"
+
+#define THERMAL_MODEL_PARAMS 4
+
+/**
+ * First order zone thermal model identified online by recursive
+ * least squares, used to pick duty by short horizon prediction.
+ *
+ *   C dT/dt = Q - (k0 + k1.d)(T - Ta)
+ *
+ * expands to a model linear in its parameters:
+ *
+ *   dT/dt = th0 + th1.T + th2.d + th3.d.T    (C per min, d 0-1)
+ *
+ * so fan cooling coefficient k1/C = -th3, passive loss k0/C = -th1
+ * and ambient Ta = -th2/th3.
+ *
+ * This is the one place float is kept: the covariance update needs
+ * the dynamic range, and it runs once per cycle per zone.
+ */
+class ThermalModel
+{
+public:
+    ThermalModel() {
+        reset();
+    };
+
+    void reset();
+
+    // add sample: zone temp and the duty applied from now on
+    void update(const int16_t tempRaw, const uint8_t duty, const unsigned long nowMs);
+
+    // enough samples and fans cool the rack
+    bool isValid() const;
+
+    // lowest cost duty over the prediction horizon
+    uint8_t chooseDuty(const int16_t tempRaw, const int16_t setpointRaw,
+                       const uint8_t minDuty, const uint8_t maxDuty) const;
+
+    float getAmbient() const;
+    float getCoolingCoeff() const { return -_theta[3]; };
+
+private:
+    float predictRate(const float t, const float d) const;
+
+    float         _theta[THERMAL_MODEL_PARAMS];
+    float         _P[THERMAL_MODEL_PARAMS][THERMAL_MODEL_PARAMS];
+    float         _prevT;
+    float         _prevD;
+    unsigned long _prevMs;
+    bool          _primed;
+    uint16_t      _samples;
+
+    static const uint8_t  _minSamples   = 30;   // before model is trusted
+    static const uint8_t  _horizonSteps = 5;    // minutes ahead
+    static const uint8_t  _dutyStep     = 5;    // candidate duty resolution %
+};
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef __THERMAL_PROFILE_H
+#define __THERMAL_PROFILE_H
+
+#include <Arduino.h>
+#include "EepromLayout.h"
+#include "RackTopology.h"
+
+#define PROFILE_BUCKETS     96  // 15 minute buckets per day
+#define PROFILE_BUCKET_MIN  15
+#define MAX_PROFILE_ZONES   4
+
+static_assert(ZONE_COUNT <= MAX_PROFILE_ZONES, "more zones than the EEPROM profile holds");
+
+/**
+ * Learned time of day profile: typical temperature rise per zone over
+ * each 15 minute bucket, held in EEPROM as int8 in 1/16 C and updated
+ * exponentially (1/8 weight) as each bucket completes. One EEPROM
+ * update per zone per bucket, so wear is negligible.
+ */
+class ThermalProfile
+{
+public:
+    // validate EEPROM block, clearing it if not ours
+    void begin();
+
+    // once per cycle: folds the previous bucket's rise in at rollover
+    void update(const uint8_t zone, const uint8_t bucket, const int16_t tempRaw);
+
+    // learned rise over bucket, 1/16 C
+    int8_t expectedRise(const uint8_t zone, const uint8_t bucket) const;
+
+private:
+    int address(const uint8_t zone, const uint8_t bucket) const {
+        return EEPROM_PROFILE_ADDR + 2 + zone * PROFILE_BUCKETS + bucket;
+    };
+
+    enum BucketState_t {
+        BUCKET_NONE,        // nothing measured yet
+        BUCKET_PARTIAL,     // joined mid-bucket, after boot or a clock step
+        BUCKET_FULL         // measured from its start, learned at rollover
+    };
+
+    int16_t       _startRaw[MAX_PROFILE_ZONES];   // zone temp at start of bucket
+    uint8_t       _bucket[MAX_PROFILE_ZONES];     // bucket being measured
+    BucketState_t _state[MAX_PROFILE_ZONES] = {};
+};
+
+#endif
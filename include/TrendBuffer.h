@@ -0,0 +1,70 @@
+#ifndef __TREND_BUFFER_H
+#define __TREND_BUFFER_H
+
+#include <Arduino.h>
+#include "RackTopology.h"
+
+#define TREND_DEPTH     10  // samples in moving window
+#define TREND_ZONES     4
+#define TREND_RACK      0   // channel of the rack mean, zones follow
+
+#define TREND_VALID(ch) (1 << (ch))
+
+/**
+ * One cycle of rack state, POD so the ring never touches the heap.
+ */
+typedef struct {
+    int16_t  rackRaw;               // mean of readable thermos, 1/16 C
+    int16_t  zoneRaw[TREND_ZONES];  // zone temps, 1/16 C
+    uint8_t  duty[FAN_COUNT];        // fanid 1 is [0]
+    uint16_t rpm[FAN_COUNT];
+    uint8_t  valid;                 // TREND_VALID(ch) per temp channel
+} TrendSample_t;
+
+/**
+ * Fixed ring of the last TREND_DEPTH samples. Running sums are kept
+ * per channel as samples enter and leave, so the moving averages and
+ * least squares slope of each temperature are O(1) to update and read.
+ * Sample positions count back from the newest (x = 0), so sliding the
+ * window shifts every x by one, which is applied to the sums directly.
+ */
+class TrendBuffer
+{
+public:
+    void push(const TrendSample_t& sample);
+
+    uint8_t size() const {
+        return _count;
+    };
+
+    // moving average of a temp channel, false if no valid samples
+    bool mean(const uint8_t ch, int16_t& raw) const;
+
+    // least squares rise across the window, 1/16 C, 0 if under 2 samples
+    int16_t rise(const uint8_t ch) const;
+
+    uint8_t meanDuty(const uint8_t fanid) const;
+    uint16_t meanRpm(const uint8_t fanid) const;
+
+private:
+    typedef struct {
+        int32_t sy;
+        int32_t sxy;
+        int16_t sx;
+        int16_t sxx;
+        uint8_t n;
+    } Sums_t;
+
+    int16_t value(const TrendSample_t& s, const uint8_t ch) const {
+        return (ch == TREND_RACK) ? s.rackRaw : s.zoneRaw[ch-1];
+    };
+
+    TrendSample_t _ring[TREND_DEPTH];
+    uint8_t       _head = 0;    // next slot to write
+    uint8_t       _count = 0;
+    Sums_t        _sums[1 + TREND_ZONES] = {};
+    uint16_t      _dutySum[FAN_COUNT] = { 0 };
+    uint32_t      _rpmSum[FAN_COUNT] = { 0 };
+};
+
+#endif
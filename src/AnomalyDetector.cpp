@@ -0,0 +1,98 @@
+#include "AnomalyDetector.h"
+
+static uint16_t isqrt32(uint32_t v) {
+    uint32_t res = 0;
+    uint32_t bit = (uint32_t)1 << 30;
+    while (bit > v)
+        bit >>= 2;
+    while (bit != 0) {
+        if (v >= res + bit) {
+            v -= res + bit;
+            res = (res >> 1) + bit;
+        }
+        else
+            res >>= 1;
+        bit >>= 2;
+    }
+    return res;
+}
+
+AnomalyKind_t AnomalyDetector::update(const int16_t x, const unsigned long nowMs) {
+
+    int32_t xs = (int32_t)x << 8;
+    if (_samples == 0) {
+        _mean = xs;
+        _var = 0;
+    }
+
+    // sigma << 4 from variance << 8
+    uint16_t sd = isqrt32(_var);
+    if (sd < (uint16_t)_minSd * 16)
+        sd = (uint16_t)_minSd * 16;
+
+    int32_t d = (xs - _mean) >> 4;      // deviation << 4
+    int32_t z = (d * 16) / sd;
+    _z = constrain(z, -32767L, 32767L);
+    _deviation = (xs - _mean + ((xs >= _mean) ? 128 : -128)) / 256;
+
+    // learn, winsorised to the spike limit; while active only the level
+    if (_active)
+        _level += (xs - _level) >> _levelShift;
+    else {
+        uint8_t shift = _alphaShift;
+        if (_samples < _warmup) {
+            shift = 0;
+            while (((uint16_t)2 << shift) <= _samples + 1)
+                shift++;
+        }
+        int32_t lim = ((int32_t)sd * _zLimit) / 16;     // << 4
+        int32_t dw = constrain(d, -lim, lim);
+        _mean += (dw * 16) >> shift;
+        int32_t sq = dw * dw;                           // << 8
+        _var += (sq - (int32_t)_var) >> shift;
+    }
+
+    if (_samples < _warmup) {
+        _samples++;
+        return ANOMALY_NONE;
+    }
+
+    // two sided CUSUM on the winsorised z, noting when each excursion began
+    int16_t zc = constrain(_z, -_zLimit, _zLimit);
+    int16_t hi = _hi + zc - _k;
+    int16_t lo = _lo - zc - _k;
+    if (_hi == 0 && hi > 0)
+        _hiStartMs = nowMs;
+    if (_lo == 0 && lo > 0)
+        _loStartMs = nowMs;
+    _hi = constrain(hi, 0, 2 * _h);
+    _lo = constrain(lo, 0, 2 * _h);
+
+    if (!_active) {
+        if (_hi > _h || _lo > _h) {
+            _active = true;
+            _activeSamples = 0;
+            _level = xs;
+            _onsetMs = (_hi > _h) ? _hiStartMs : _loStartMs;
+            return (_hi > _h) ? ANOMALY_SHIFT_UP : ANOMALY_SHIFT_DOWN;
+        }
+        if (_z > _zLimit || _z < -_zLimit) {
+            _onsetMs = nowMs;
+            return ANOMALY_SPIKE;
+        }
+    }
+    else if (_hi < _h / 2 && _lo < _h / 2) {
+        _active = false;
+        return ANOMALY_CLEARED;
+    }
+    else if (++_activeSamples >= _relearnAfter) {
+        // a step change, deviation is the step from the old baseline
+        _deviation = (_level - _mean + ((_level >= _mean) ? 128 : -128)) / 256;
+        _mean = _level;
+        _hi = _lo = 0;
+        _active = false;
+        _onsetMs = nowMs;
+        return ANOMALY_REBASED;
+    }
+    return ANOMALY_NONE;
+}
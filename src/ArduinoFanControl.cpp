@@ -11,30 +11,71 @@ volatile uint16_t ArduinoFanControl_tach2 = 0;
 volatile uint16_t ArduinoFanControl_tach3 = 0;
 volatile uint16_t ArduinoFanControl_tach4 = 0;
 
+// tach timing per fan, for stall detection and jitter
+volatile unsigned long ArduinoFanControl_edgeMs[4]     = { 0 };
+volatile uint8_t       ArduinoFanControl_edges[4]      = { 0 };
+volatile unsigned long ArduinoFanControl_lastEdgeUs[4] = { 0 };
+volatile unsigned long ArduinoFanControl_lastPeriod[4] = { 0 };
+volatile uint32_t      ArduinoFanControl_periodSum[4]  = { 0 };
+volatile uint32_t      ArduinoFanControl_jitterSum[4]  = { 0 };
+volatile uint16_t      ArduinoFanControl_periods[4]    = { 0 };
+
+/**
+ * Every second CHANGE edge closes a full tach period. Periods over
+ * 1s are a stopped or starting fan and restart the measurement.
+ */
+static inline void ArduinoFanControl_tachPeriod(const uint8_t i)
+{
+    ArduinoFanControl_edgeMs[i] = millis();
+    if (++ArduinoFanControl_edges[i] & 1)
+        return;
+
+    unsigned long now = micros();
+    unsigned long period = now - ArduinoFanControl_lastEdgeUs[i];
+    ArduinoFanControl_lastEdgeUs[i] = now;
+    if (period > 1000000) {
+        ArduinoFanControl_lastPeriod[i] = 0;
+        return;
+    }
+
+    unsigned long last = ArduinoFanControl_lastPeriod[i];
+    if (last != 0 && ArduinoFanControl_periods[i] < 0xFFFF) {
+        ArduinoFanControl_jitterSum[i] += (period > last) ? period - last : last - period;
+        ArduinoFanControl_periodSum[i] += period;
+        ArduinoFanControl_periods[i]++;
+    }
+    ArduinoFanControl_lastPeriod[i] = period;
+}
+
 // externs
 void ArduinoFanControl_tach1Count()
 {
     ArduinoFanControl_tach1++;
+    ArduinoFanControl_tachPeriod(0);
 }
 
 void ArduinoFanControl_tach2Count()
 {
     ArduinoFanControl_tach2++;
+    ArduinoFanControl_tachPeriod(1);
 }
 
 void ArduinoFanControl_tach3Count()
 {
     ArduinoFanControl_tach3++;
+    ArduinoFanControl_tachPeriod(2);
 }
 
 void ArduinoFanControl_tach4Count()
 {
     ArduinoFanControl_tach4++;
+    ArduinoFanControl_tachPeriod(3);
 }
 
-ArduinoFanControl::ArduinoFanControl(const uint8_t fans) : 
+ArduinoFanControl::ArduinoFanControl(const uint8_t fans, const bool staggered) : 
     FanControl(fans), 
-    _pwmPeriod(40) {}  // 40us == 25kHz
+    _pwmPeriod(40),    // 40us == 25kHz
+    _staggered(staggered) {}
 
 /**
  * Initialise as PWM timers, tach inputs and
@@ -45,6 +86,8 @@ RESULT ArduinoFanControl::initialise()
     // Use two timers to drive 4 PWM pins - 2 each
     Timer1.initialize(_pwmPeriod);
     Timer3.initialize(_pwmPeriod);
+    if (_staggered)
+        alignTimers();
 
     // For reading TACHs
     // Pullup - since TACH output is open collector and pullup rc reduces noise.
@@ -67,32 +110,67 @@ RESULT ArduinoFanControl::initialise()
     return RES_OK;
 }
 
+/**
+ * Timers run PWM phase and frequency correct (TOP = ICR), so pulses are
+ * centred on BOTTOM. Starting Timer3 TOP/2 counts from Timer1 shifts its
+ * pulses a quarter period. The counters are written back to back with
+ * interrupts off so the skew is a few clocks of the 640 clock period.
+ */
+void ArduinoFanControl::alignTimers()
+{
+    uint8_t sreg = SREG;
+    noInterrupts();
+    TCNT1 = 0;
+    TCNT3 = ICR3 / 2;
+    SREG = sreg;
+}
+
 /**
  * Set PWM for fanid.
  * dutyCycle is ranged 0 to 100
+ *
+ * When staggered, fans 2 and 4 use inverting compare output with the
+ * complement duty. The same high time is then centred on TOP rather
+ * than BOTTOM, half a period from fans 1 and 3. The four fans switch on
+ * at 0, 90, 180 and 270 degrees, so inrush peaks do not coincide. The
+ * average duty is unchanged.
  */
 RESULT ArduinoFanControl::setPWM(const uint8_t fanid, const uint16_t dutyCycle)
 {
     ASSERT_RANGE_DUTY_CYCLE(dutyCycle);
     ASSERT_RANGE_FAN_ID(fanid, getFanCount());
 
-    // duty is from 0 to 1023
+    // duty is from 0 to 1023. Inverted channels take 1023 - duty, except
+    // 0% which compares at the full period so there is no output at all
+    // rather than a one count pulse
+    uint16_t duty = ((uint32_t)dutyCycle * 1023) / 100;
+    uint16_t inverted = (duty == 0) ? 1024 : 1023 - duty;
     switch (fanid)
     {
     case 1:
-        Timer1.pwm(PIN_FAN1_T1, ((float)dutyCycle / 100) * 1023);
+        Timer1.pwm(PIN_FAN1_T1, duty);
         break;
 
     case 2:
-        Timer1.pwm(PIN_FAN2_T1, ((float)dutyCycle / 100) * 1023);
+        if (_staggered) {
+            Timer1.pwm(PIN_FAN2_T1, inverted);
+            TCCR1A |= _BV(COM1B0);  // inverting
+        }
+        else
+            Timer1.pwm(PIN_FAN2_T1, duty);
         break;
 
     case 3:
-        Timer3.pwm(PIN_FAN3_T3, ((float)dutyCycle / 100) * 1023);
+        Timer3.pwm(PIN_FAN3_T3, duty);
         break;
 
     case 4:
-        Timer3.pwm(PIN_FAN4_T3, ((float)dutyCycle / 100) * 1023);
+        if (_staggered) {
+            Timer3.pwm(PIN_FAN4_T3, inverted);
+            TCCR3A |= _BV(COM3C0);  // inverting
+        }
+        else
+            Timer3.pwm(PIN_FAN4_T3, duty);
         break;
 
     default:
@@ -102,6 +180,25 @@ RESULT ArduinoFanControl::setPWM(const uint8_t fanid, const uint16_t dutyCycle)
     return RES_OK;
 }
 
+/**
+ * Set PWM for each fan, dutyCycles[0] is fan 1.
+ * Compare registers are written in one critical section so all
+ * channels change within the same PWM period.
+ */
+RESULT ArduinoFanControl::setPWMs(const uint8_t* dutyCycles)
+{
+    for (int i=0; i<getFanCount(); i++) {
+        ASSERT_RANGE_DUTY_CYCLE(dutyCycles[i]);
+    }
+
+    noInterrupts();
+    for (int i=0; i<getFanCount(); i++) {
+        setPWM(i+1, dutyCycles[i]);
+    }
+    interrupts();
+    return RES_OK;
+}
+
 /**
  * Set PWM for all fans to duty
  */
@@ -137,6 +234,82 @@ RESULT ArduinoFanControl::getRPM(const uint8_t fanid, uint16_t& rpm)
     return RES_OK;
 }
 
+/**
+ * Opens one tach window for all fans, counts reset together.
+ */
+RESULT ArduinoFanControl::startRPMs()
+{
+    noInterrupts();
+    ArduinoFanControl_tach1 = 0;
+    ArduinoFanControl_tach2 = 0;
+    ArduinoFanControl_tach3 = 0;
+    ArduinoFanControl_tach4 = 0;
+    _tachStartMs = millis();
+    interrupts();
+
+    _tachOpen = true;
+    return RES_OK;
+}
+
+/**
+ * Rpm of all fans counted since startRPMs(). The caller waits out the
+ * window, 750ms or so gives a few counts per rpm step at low speed.
+ */
+RESULT ArduinoFanControl::getRPMs(uint16_t* rpms)
+{
+    // counts are 16 bit, read them with the ISRs held off
+    noInterrupts();
+    unsigned long ms = millis() - _tachStartMs;
+    float tHz[4];
+    for (uint8_t i = 0; i < getFanCount() && i < 4; i++)
+        tHz[i] = (ms == 0) ? 0 : readTach(i+1, ms);
+    interrupts();
+
+    if (!_tachOpen || ms == 0) {
+        memset(rpms, 0, getFanCount() * sizeof(uint16_t));
+        return ERR_FAN_TACH;
+    }
+    _tachOpen = false;
+
+    for (uint8_t i = 0; i < getFanCount() && i < 4; i++) {
+        uint16_t tachHz = round(tHz[i]);
+        rpms[i] = (tachHz * 60.0) / 2;  // 2 pulses per revolution, see getRPM()
+    }
+    return RES_OK;
+}
+
+RESULT ArduinoFanControl::getTachEdgeAge(const uint8_t fanid, unsigned long& ageMs)
+{
+    ASSERT_RANGE_FAN_ID(fanid, getFanCount());
+
+    noInterrupts();
+    unsigned long edgeMs = ArduinoFanControl_edgeMs[fanid-1];
+    interrupts();
+    ageMs = millis() - edgeMs;
+    return RES_OK;
+}
+
+/**
+ * Jitter accumulated by the tach ISRs since the last call, as mean
+ * |period - previous period| over mean period in 0.1%.
+ */
+RESULT ArduinoFanControl::getTachJitter(const uint8_t fanid, uint16_t& jitterPm)
+{
+    ASSERT_RANGE_FAN_ID(fanid, getFanCount());
+
+    uint8_t i = fanid - 1;
+    noInterrupts();
+    uint32_t jitterSum = ArduinoFanControl_jitterSum[i];
+    uint32_t periodSum = ArduinoFanControl_periodSum[i];
+    ArduinoFanControl_jitterSum[i] = 0;
+    ArduinoFanControl_periodSum[i] = 0;
+    ArduinoFanControl_periods[i] = 0;
+    interrupts();
+
+    jitterPm = (periodSum == 0) ? 0 : ((uint64_t)jitterSum * 1000) / periodSum;
+    return RES_OK;
+}
+
 // private
 
 void ArduinoFanControl::measureTach(const uint8_t fanid, unsigned long msWait)
@@ -157,11 +330,8 @@ void ArduinoFanControl::measureTach(const uint8_t fanid, unsigned long msWait)
             break;
     }
 
-    // force wait to accumulate interrupts
-    unsigned long t1 = millis();
-    do {
-        // nop
-    } while ((millis() - t1) < msWait);
+    // wait to accumulate interrupts
+    delay(msWait);
 }
 
 float ArduinoFanControl::readTach(const uint8_t fanid, unsigned long ms)
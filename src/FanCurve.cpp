@@ -0,0 +1,23 @@
+#include "FanCurve.h"
+
+/**
+ * Duty % for raw temp at nowMs, with hysteresis and dwell applied.
+ */
+uint8_t FanCurve::update(const int16_t raw, const unsigned long nowMs) {
+
+    uint8_t rising = _lookup(raw);
+    if (!_primed || rising > _duty) {
+        _duty = rising;
+        _changedMs = nowMs;
+        _primed = true;
+        return _duty;
+    }
+
+    // falling: evaluate the curve as if hysteresis degrees hotter
+    uint8_t falling = _lookup(raw + _hysteresis);
+    if (falling < _duty && (nowMs - _changedMs) >= _dwellMs) {
+        _duty = falling;
+        _changedMs = nowMs;
+    }
+    return _duty;
+}
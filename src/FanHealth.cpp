@@ -0,0 +1,130 @@
+#include "FanHealth.h"
+#include <EEPROM.h>
+#include <ArduinoLog.h>
+
+#define HEALTH_MAGIC   0x3C
+#define HEALTH_VERSION 2    // 2: ratios against the minRpm..maxRpm duty line
+
+void FanHealth::begin() {
+    bool valid = EEPROM.read(EEPROM_FANHEALTH_ADDR) == HEALTH_MAGIC &&
+                 EEPROM.read(EEPROM_FANHEALTH_ADDR + 1) == HEALTH_VERSION;
+    if (!valid)
+        Log.notice(F("Initialising fan health"));
+
+    for (uint8_t f = 0; f < FAN_COUNT; f++) {
+        for (uint8_t r = 0; r < HEALTH_REF_DUTIES; r++) {
+            if (valid)
+                EEPROM.get(address(f, r), _refs[f][r]);
+            else {
+                memset(&_refs[f][r], 0, sizeof(Ref_t));
+                EEPROM.put(address(f, r), _refs[f][r]);
+            }
+        }
+    }
+    EEPROM.update(EEPROM_FANHEALTH_ADDR, HEALTH_MAGIC);
+    EEPROM.update(EEPROM_FANHEALTH_ADDR + 1, HEALTH_VERSION);
+
+    _loaded = true;
+    score();
+}
+
+void FanHealth::sample(const uint8_t fanid, const uint8_t duty, const uint16_t ratioPm, const uint16_t jitterPm) {
+
+    if (fanid < 1 || fanid > FAN_COUNT)
+        return;
+    uint8_t f = fanid - 1;
+
+    if (_jitterQ4[f] == 0)
+        _jitterQ4[f] = (uint32_t)jitterPm << 4;
+    else
+        _jitterQ4[f] += (((int32_t)jitterPm << 4) - (int32_t)_jitterQ4[f]) / 16;
+
+    for (uint8_t r = 0; r < HEALTH_REF_DUTIES; r++) {
+        if (duty + _refBand >= _refDuty[r] && duty <= _refDuty[r] + _refBand &&
+            _dayCount[f][r] < 0xFFFF) {
+            _daySum[f][r] += ratioPm;
+            _dayCount[f][r]++;
+        }
+    }
+}
+
+bool FanHealth::maintain(const unsigned long nowMs) {
+
+    if (!_loaded)
+        return false;
+
+    if ((nowMs - _dayMs) >= _dayPeriodMs) {
+        _dayMs = nowMs;
+        for (uint8_t f = 0; f < FAN_COUNT; f++) {
+            for (uint8_t r = 0; r < HEALTH_REF_DUTIES; r++) {
+                Ref_t& ref = _refs[f][r];
+                if (_dayCount[f][r] >= _minDaySamples) {
+                    int32_t day = _daySum[f][r] / _dayCount[f][r];
+                    if (ref.days == 0)
+                        ref.currentPm = day;
+                    else
+                        ref.currentPm += (day - (int32_t)ref.currentPm) / 4;
+                    if (ref.days < 0xFF)
+                        ref.days++;
+                    if (ref.days == _baselineDays)
+                        ref.baselinePm = ref.currentPm;
+                    EEPROM.put(address(f, r), ref);
+                }
+                _daySum[f][r] = 0;
+                _dayCount[f][r] = 0;
+            }
+        }
+    }
+
+    if (_scored && (nowMs - _scoreMs) < _scorePeriodMs)
+        return false;
+    _scoreMs = nowMs;
+    _scored = true;
+    score();
+    return true;
+}
+
+/**
+ * 5 points per 1% of rpm loss beyond _driftAllowPm and per 1% of
+ * jitter beyond _jitterAllowPm.
+ */
+void FanHealth::score() {
+    for (uint8_t fanid = 1; fanid <= FAN_COUNT; fanid++) {
+        int16_t loss = -getDrift(fanid) - _driftAllowPm;
+        int16_t jitter = (int16_t)getJitter(fanid) - _jitterAllowPm;
+        int16_t s = 100;
+        if (loss > 0)
+            s -= loss / 2;
+        if (jitter > 0)
+            s -= jitter / 2;
+        _score[fanid-1] = constrain(s, 0, 100);
+    }
+}
+
+uint8_t FanHealth::getScore(const uint8_t fanid) const {
+    if (fanid < 1 || fanid > FAN_COUNT)
+        return 0;
+    return _score[fanid-1];
+}
+
+int16_t FanHealth::getDrift(const uint8_t fanid) const {
+    if (fanid < 1 || fanid > FAN_COUNT)
+        return 0;
+
+    int16_t worst = 0;
+    for (uint8_t r = 0; r < HEALTH_REF_DUTIES; r++) {
+        const Ref_t& ref = _refs[fanid-1][r];
+        if (ref.baselinePm == 0)
+            continue;
+        int16_t drift = (((int32_t)ref.currentPm - ref.baselinePm) * 1000) / ref.baselinePm;
+        if (drift < worst)
+            worst = drift;
+    }
+    return worst;
+}
+
+uint16_t FanHealth::getJitter(const uint8_t fanid) const {
+    if (fanid < 1 || fanid > FAN_COUNT)
+        return 0;
+    return (_jitterQ4[fanid-1] + 8) >> 4;
+}
@@ -0,0 +1,48 @@
+#include "FanRunHours.h"
+#include <EEPROM.h>
+#include <ArduinoLog.h>
+
+#define RUNHOURS_MAGIC   0x5A
+#define RUNHOURS_VERSION 1
+
+void FanRunHours::begin() {
+    if (EEPROM.read(EEPROM_RUNHOURS_ADDR) == RUNHOURS_MAGIC &&
+        EEPROM.read(EEPROM_RUNHOURS_ADDR + 1) == RUNHOURS_VERSION) {
+        for (uint8_t i = 1; i <= FAN_COUNT; i++)
+            EEPROM.get(address(i), _minutes[i-1]);
+    }
+    else {
+        Log.notice(F("Initialising fan run hours"));
+        for (uint8_t i = 1; i <= FAN_COUNT; i++) {
+            _minutes[i-1] = 0;
+            EEPROM.put(address(i), _minutes[i-1]);
+        }
+        EEPROM.update(EEPROM_RUNHOURS_ADDR, RUNHOURS_MAGIC);
+        EEPROM.update(EEPROM_RUNHOURS_ADDR + 1, RUNHOURS_VERSION);
+    }
+    _loaded = true;
+}
+
+void FanRunHours::accumulate(const uint8_t fanid, const unsigned long ms) {
+    if (fanid < 1 || fanid > FAN_COUNT)
+        return;
+    _partialMs[fanid-1] += ms;
+    _minutes[fanid-1]   += _partialMs[fanid-1] / 60000;
+    _partialMs[fanid-1] %= 60000;
+}
+
+void FanRunHours::maintain(const unsigned long nowMs) {
+    if (!_loaded || (nowMs - _flushMs) < _flushPeriodMs)
+        return;
+
+    // put() only writes bytes that changed
+    for (uint8_t i = 1; i <= FAN_COUNT; i++)
+        EEPROM.put(address(i), _minutes[i-1]);
+    _flushMs = nowMs;
+}
+
+uint32_t FanRunHours::getMinutes(const uint8_t fanid) const {
+    if (fanid < 1 || fanid > FAN_COUNT)
+        return 0;
+    return _minutes[fanid-1];
+}
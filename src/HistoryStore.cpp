@@ -0,0 +1,186 @@
+#include "HistoryStore.h"
+
+void HistoryStore::begin(const uint8_t channels) {
+    if (channels == _channels && _filled > 0)
+        return;
+    _channels = (channels > HISTORY_CHANNELS) ? HISTORY_CHANNELS : channels;
+    _head = 0;
+    _filled = 0;
+}
+
+uint16_t HistoryStore::getRecords() const {
+    uint16_t n = 0;
+    for (uint8_t b = 0; b < _filled; b++)
+        n += _headers[slot(b)].records;
+    return n;
+}
+
+void HistoryStore::rebase(const int32_t offset) {
+    for (uint8_t b = 0; b < _filled; b++) {
+        uint8_t i = slot(b);
+        if (_headers[i].records == 0)
+            continue;
+        uint16_t bit = 0;
+        uint32_t t = getBits(i, bit, 32) + offset;
+        for (uint8_t k = 0; k < 4; k++)
+            _data[i][k] = t >> (24 - 8 * k);
+    }
+    _prev.t += offset;
+}
+
+void HistoryStore::startBlock() {
+    if (_filled > 0)
+        _head = (_head + 1) % HISTORY_BLOCKS;
+    if (_filled < HISTORY_BLOCKS)
+        _filled++;
+    _headers[_head].bits = 0;
+    _headers[_head].records = 0;
+    memset(_data[_head], 0, HISTORY_BLOCK_BYTES);
+}
+
+void HistoryStore::append(const HistoryRecord_t& r) {
+
+    if (_channels == 0)
+        return;
+
+    if (_filled == 0 || _headers[_head].records == 0xFF ||
+        _headers[_head].bits + maxRecordBits() > HISTORY_BLOCK_BYTES * 8)
+        startBlock();
+
+    BlockHeader_t& h = _headers[_head];
+    if (h.records == 0) {
+        // key record, stored in full
+        putBits(r.t, 32);
+        for (uint8_t c = 0; c < _channels; c++)
+            putBits((uint16_t)r.v[c], 16);
+        _prevDelta = 0;
+    }
+    else {
+        int32_t delta = r.t - _prev.t;
+        int32_t dod = (int32_t)((uint32_t)delta - (uint32_t)_prevDelta);   // wraps, as t does
+        if (dod == 0)
+            putBits(0, 1);
+        else if (dod >= -8 && dod <= 7) {
+            putBits(0x2, 2);
+            putBits(dod & 0xF, 4);
+        }
+        else if (dod >= -128 && dod <= 127) {
+            putBits(0x6, 3);
+            putBits(dod & 0xFF, 8);
+        }
+        else {
+            putBits(0x7, 3);
+            putBits(dod, 32);
+        }
+        _prevDelta = delta;
+
+        for (uint8_t c = 0; c < _channels; c++)
+            putValue(r.v[c] - _prev.v[c]);
+    }
+
+    _prev = r;
+    h.records++;
+}
+
+void HistoryStore::putValue(const int16_t delta) {
+    uint16_t zz = ((uint16_t)delta << 1) ^ (uint16_t)(delta >> 15);
+    if (zz == 0)
+        putBits(0, 1);
+    else if (zz < 8) {
+        putBits(0x2, 2);
+        putBits(zz, 3);
+    }
+    else if (zz < 64) {
+        putBits(0x6, 3);
+        putBits(zz, 6);
+    }
+    else if (zz < 1024) {
+        putBits(0xE, 4);
+        putBits(zz, 10);
+    }
+    else {
+        putBits(0xF, 4);
+        putBits(zz, 16);
+    }
+}
+
+// msb first
+void HistoryStore::putBits(uint32_t value, const uint8_t n) {
+    BlockHeader_t& h = _headers[_head];
+    for (int8_t i = n - 1; i >= 0; i--) {
+        if (value & ((uint32_t)1 << i))
+            _data[_head][h.bits >> 3] |= 0x80 >> (h.bits & 7);
+        h.bits++;
+    }
+}
+
+uint32_t HistoryStore::getBits(const uint8_t block, uint16_t& bit, const uint8_t n) const {
+    uint32_t value = 0;
+    for (uint8_t i = 0; i < n; i++) {
+        value = (value << 1) | ((_data[block][bit >> 3] >> (7 - (bit & 7))) & 1);
+        bit++;
+    }
+    return value;
+}
+
+HistoryStore::Reader::Reader(const HistoryStore& store) :
+    _store(store),
+    _block(0),
+    _bit(0),
+    _index(0),
+    _prevDelta(0) {}
+
+bool HistoryStore::Reader::next(HistoryRecord_t& r) {
+
+    while (_block < _store._filled && _index >= _store._headers[_store.slot(_block)].records) {
+        _block++;
+        _bit = 0;
+        _index = 0;
+    }
+    if (_block >= _store._filled)
+        return false;
+
+    uint8_t b = _store.slot(_block);
+    uint8_t channels = _store._channels;
+    memset(&r, 0, sizeof(r));
+
+    if (_index == 0) {
+        r.t = _store.getBits(b, _bit, 32);
+        for (uint8_t c = 0; c < channels; c++)
+            r.v[c] = (int16_t)_store.getBits(b, _bit, 16);
+        _prevDelta = 0;
+    }
+    else {
+        int32_t dod;
+        if (_store.getBits(b, _bit, 1) == 0)
+            dod = 0;
+        else if (_store.getBits(b, _bit, 1) == 0)
+            dod = (int8_t)(_store.getBits(b, _bit, 4) << 4) >> 4;
+        else if (_store.getBits(b, _bit, 1) == 0)
+            dod = (int8_t)_store.getBits(b, _bit, 8);
+        else
+            dod = (int32_t)_store.getBits(b, _bit, 32);
+        _prevDelta = (int32_t)((uint32_t)_prevDelta + (uint32_t)dod);
+        r.t = _prev.t + _prevDelta;
+
+        for (uint8_t c = 0; c < channels; c++) {
+            uint16_t zz;
+            if (_store.getBits(b, _bit, 1) == 0)
+                zz = 0;
+            else if (_store.getBits(b, _bit, 1) == 0)
+                zz = _store.getBits(b, _bit, 3);
+            else if (_store.getBits(b, _bit, 1) == 0)
+                zz = _store.getBits(b, _bit, 6);
+            else if (_store.getBits(b, _bit, 1) == 0)
+                zz = _store.getBits(b, _bit, 10);
+            else
+                zz = _store.getBits(b, _bit, 16);
+            int16_t delta = (int16_t)(zz >> 1) ^ -(int16_t)(zz & 1);
+            r.v[c] = _prev.v[c] + delta;
+        }
+    }
+
+    _prev = r;
+    _index++;
+    return true;
+}
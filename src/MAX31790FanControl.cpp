@@ -87,6 +87,24 @@ RESULT MAX31790::setPWM(const uint8_t fanid, const uint16_t dutyCycle)
     return writeBytes(PWMOUT_TARGET_DUTY_CYCLE(fanid), &buffer[0], 2);
 }
 
+/**
+ * Set PWM for each fan, dutyCycles[0] is fan 1.
+ * Target duty registers are contiguous so all fans are
+ * written in a single auto-incremented I2C transaction.
+ */
+RESULT MAX31790::setPWMs(const uint8_t* dutyCycles)
+{
+    uint8_t buffer[2*MAX_FANS];
+    for (int i = 0; i < getFanCount(); i++)
+    {
+        ASSERT_RANGE_DUTY_CYCLE(dutyCycles[i]);
+        uint16_t pwm_bit = scaleDutyCycle(dutyCycles[i]) << 7;
+        buffer[2*i]   = pwm_bit >> 8;
+        buffer[2*i+1] = pwm_bit;
+    }
+    return writeBytes(PWMOUT_TARGET_DUTY_CYCLE(1), &buffer[0], 2*getFanCount());
+}
+
 /**
  * Set PWM for all fans to duty
  */
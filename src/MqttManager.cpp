@@ -3,6 +3,59 @@
 
 extern void onMqttMessage(int messageSize);
 
+#define TOPIC_LOADHINT "device/rack/loadhint"   // hosts publish "<level>[W] <ttl s>" to /<host>
+
+// fixed topics
+static const char TOPIC_TEMP_AVE[]     PROGMEM = "device/temp/rack/average";
+static const char TOPIC_DEGRADED[]     PROGMEM = "device/rack/degraded";     // 1 while a fan has failed
+static const char TOPIC_POWER[]        PROGMEM = "device/rack/power";        // % of PoE budget
+static const char TOPIC_ANOMALY[]      PROGMEM = "device/rack/anomaly";      // "<signal> <kind> <magnitude> <onset>"
+static const char TOPIC_CONFIG[]       PROGMEM = "device/rack/config";       // display on/off subscriber topic
+static const char TOPIC_LOADHINT_ALL[] PROGMEM = TOPIC_LOADHINT "/#";
+static const char TOPIC_LOADHINT_PRE[] PROGMEM = TOPIC_LOADHINT "/";
+static const char TOPIC_HISTORY[]      PROGMEM = "device/rack/history";      // "<t> <v>..." lines
+static const char TOPIC_HISTORY_GET[]  PROGMEM = "device/rack/history/get";  // any payload requests export
+static const char TOPIC_LOG[]          PROGMEM = "device/rack/log";
+static const char TOPIC_STACK[]        PROGMEM = "device/rack/stack";        // "<task> <free bytes>"
+
+// per device topics, expanded from RackTopology.h
+typedef struct {
+    char temp[RACK_TOPIC_LEN];      // C
+    char ewma[RACK_TOPIC_LEN];      // C
+    char slope[RACK_TOPIC_LEN];     // C per minute
+    char stats[RACK_TOPIC_LEN];
+    char fault[RACK_TOPIC_LEN];     // "<state> <error> <errors> <faults>"
+} ThermoTopics_t;
+
+typedef struct {
+    char health[RACK_TOPIC_LEN];    // "<score> <drift> <jitter>"
+    char stats[RACK_TOPIC_LEN];
+    char fault[RACK_TOPIC_LEN];
+} FanTopics_t;
+
+typedef struct {
+    char ewma[RACK_TOPIC_LEN];
+    char slope[RACK_TOPIC_LEN];
+} ZoneTopics_t;
+
+#define THERMO_TOPICS(id, name, topic, label, slot, addr) { \
+    "device/temp/rack/" topic, \
+    "device/temp/rack/sensor/" name "/ewma", \
+    "device/temp/rack/sensor/" name "/slope", \
+    "device/rack/stats/" name, \
+    "device/rack/fault/" name },
+#define FAN_TOPICS(id, fanid, minRpm, maxRpm, minDuty, maxDuty, idleMw, maxMw, col, row) { \
+    "device/rack/fan/" #id "/health", \
+    "device/rack/stats/fan" #fanid, \
+    "device/rack/fault/" #id },
+#define ZONE_TOPICS(id, name, aggregate, thermos, weights, fans) { \
+    "device/rack/zone/" name "/ewma", \
+    "device/rack/zone/" name "/slope" },
+
+static const ThermoTopics_t THERMO_TOPIC[THERMO_COUNT] PROGMEM = { RACK_THERMOS(THERMO_TOPICS) };
+static const FanTopics_t    FAN_TOPIC[FAN_COUNT]       PROGMEM = { RACK_FANS(FAN_TOPICS) };
+static const ZoneTopics_t   ZONE_TOPIC[ZONE_COUNT]     PROGMEM = { RACK_ZONES(ZONE_TOPICS) };
+
 int MqttManager::initialise()
 {
     _p_mqttClient->setId(_clientID);
@@ -18,12 +71,19 @@ int MqttManager::initialise()
     _p_mqttClient->onMessage(::onMqttMessage);
 
     // subscribe to config topic
-    _p_mqttClient->subscribe(topicConfig);
+    char topic[RACK_TOPIC_LEN];
+    _p_mqttClient->subscribe(strcpy_P(topic, TOPIC_CONFIG));
+
+    // subscribe to history export requests
+    _p_mqttClient->subscribe(strcpy_P(topic, TOPIC_HISTORY_GET));
+
+    // subscribe to load hints from all hosts
+    _p_mqttClient->subscribe(strcpy_P(topic, TOPIC_LOADHINT_ALL));
 
     return 0;
 }
 
-void MqttManager::publish(RackState_t& rs) {
+void MqttManager::publish(const RackView_t& rs) {
     
     if (!_p_mqttClient->connected()) {
         Log.error(F("Mqtt connection lost ... attempting reconnection"));
@@ -31,47 +91,251 @@ void MqttManager::publish(RackState_t& rs) {
     }
 
     Log.notice(F("Publishing temperature events"));
-    sendMessage(topicTempRackTop, String(rs.thermos["topRack"].tempCelsuis));
-    sendMessage(topicTempRackBase, String(rs.thermos["baseRack"].tempCelsuis));
-    sendMessage(topicTempRackAve, String(rs.aveTempCelsius));
-    
-    //Log.notice(F("Publishing fan events"));
-    /*
-    sendMessage(topicFanBaseLeft + subtopicFanRPM, String(rs.fanTopLeft.rpm));
-    sendMessage(topicFanTopRight + subtopicFanRPM, String(rs.fanTopRight.rpm));
-    sendMessage(topicFanBaseLeft + subtopicFanRPM, String(rs.fanBaseLeft.rpm));
-    sendMessage(topicFanTopRight + subtopicFanRPM, String(rs.fanBaseRight.rpm));
-    */
-
-    // if (rs.hasFanError()) {  
-    //     for each fan in error
-    //        sendMessage(topicRackFanError, rs.fanid)
-    //}
-    
+    char buf[8];
+    for (uint8_t i = 0; i < rs.thermoCount; i++)
+        sendMessage(THERMO_TOPIC[i].temp, formatTempRaw(rs.thermos[i].tempRaw, buf));
+    sendMessage(TOPIC_TEMP_AVE, formatTempRaw(rs.aveTempRaw, buf));
+    sendMessage(TOPIC_DEGRADED, rs.degraded ? "1" : "0");
+    sendMessage(TOPIC_POWER, String(rs.powerUtil));
+
+    char sbuf[12];
+    for (uint8_t i = 0; i < rs.thermoCount; i++) {
+        const ThermoView_t& thermo = rs.thermos[i];
+        if (!thermo.trend.primed)
+            continue;
+        sendMessage(THERMO_TOPIC[i].ewma, formatTempRaw(ewmaRaw(thermo.trend), buf));
+        sendMessage(THERMO_TOPIC[i].slope, formatSlope(ewmaSlope(thermo.trend), sbuf));
+    }
+    for (uint8_t z = 0; z < rs.zoneCount; z++) {
+        const Ewma_t& trend = rs.zoneTrends[z];
+        if (!trend.primed)
+            continue;
+        sendMessage(ZONE_TOPIC[z].ewma, formatTempRaw(ewmaRaw(trend), buf));
+        sendMessage(ZONE_TOPIC[z].slope, formatSlope(ewmaSlope(trend), sbuf));
+    }
+
+    publishStats(rs);
+    publishHealth(rs);
+    publishFaults(rs);
+}
+
+/**
+ * Record is "<count> <min> <max> <mean> <p50> <p95> <p99>", temps
+ * in C and duties in %.
+ */
+void MqttManager::publishStats(const RackView_t& rs) {
+
+    if (rs.stats.seq == _statsSeq)
+        return;
+    _statsSeq = rs.stats.seq;
+
+    Log.notice(F("Publishing interval statistics"));
+    char buf[8];
+    uint8_t i;
+    for (i = 0; i < rs.thermoCount; i++) {
+        const StatsSummary_t& s = rs.stats.thermos[i];
+        if (s.count == 0)
+            continue;
+        String msg = String(s.count);
+        msg += " "; msg += formatTempRaw(s.min, buf);
+        msg += " "; msg += formatTempRaw(s.max, buf);
+        msg += " "; msg += formatTempRaw(s.mean, buf);
+        msg += " "; msg += formatTempRaw(s.p50, buf);
+        msg += " "; msg += formatTempRaw(s.p95, buf);
+        msg += " "; msg += formatTempRaw(s.p99, buf);
+        sendMessage(THERMO_TOPIC[i].stats, msg);
+    }
+
+    for (i = 0; i < rs.fanCount; i++) {
+        const StatsSummary_t& s = rs.stats.duty[i];
+        if (s.count == 0)
+            continue;
+        String msg = String(s.count) + " " + String(s.min) + " " + String(s.max) + " " +
+            String(s.mean) + " " + String(s.p50) + " " + String(s.p95) + " " + String(s.p99);
+        sendMessage(FAN_TOPIC[i].stats, msg);
+    }
+}
+
+/**
+ * Streams the history out as lines of "<t> <v>...", temps raw 1/16 C
+ * and rpms, after a "t <name>..." header. Lines are batched into
+ * messages of about _historyChunk bytes.
+ */
+void MqttManager::publishHistory(const HistoryStore& history, const RackView_t& rs) {
+
+    if (!_p_mqttClient->connected())
+        return;
+
+    Log.notice(F("Exporting %d history records"), history.getRecords());
+
+    String msg = "t";
+    uint8_t c = 0;
+    for (uint8_t i = 0; i < rs.thermoCount && c < history.getChannels(); i++, c++) {
+        msg += " ";
+        msg += FNAME(rs.thermos[i].name);
+    }
+    for (uint8_t i = 0; i < rs.fanCount && c < history.getChannels(); i++, c++)
+        msg += " fan" + String(i+1);
+    msg += "\n";
+
+    HistoryStore::Reader reader(history);
+    HistoryRecord_t r;
+    while (reader.next(r)) {
+        msg += String(r.t);
+        for (c = 0; c < history.getChannels(); c++)
+            msg += " " + String(r.v[c]);
+        msg += "\n";
+        if (msg.length() >= _historyChunk) {
+            sendMessage(TOPIC_HISTORY, msg);
+            msg = "";
+        }
+    }
+    if (msg.length() > 0)
+        sendMessage(TOPIC_HISTORY, msg);
+}
+
+/**
+ * Kind is spike, up, down, cleared or rebased. Magnitude is the deviation from
+ * baseline in C for thermos and % of expected rpm for fans. Onset is
+ * unix time, or uptime seconds before the clock syncs.
+ */
+void MqttManager::publishAnomaly(const AnomalyEvent_t& e) {
+
+    static const char* kinds[] = { "none", "spike", "up", "down", "cleared", "rebased" };
+
+    char buf[8];
+    String msg = String(FNAME(e.signal)) + " " + kinds[e.kind] + " ";
+    if (e.fan) {
+        uint16_t a = (e.magnitude < 0) ? -e.magnitude : e.magnitude;
+        sprintf(buf, "%s%u.%u", (e.magnitude < 0) ? "-" : "", a / 10, a % 10);
+        msg += buf;
+    }
+    else
+        msg += formatTempRaw(e.magnitude, buf);
+    msg += " " + String(e.onset);
+    sendMessage(TOPIC_ANOMALY, msg);
+}
+
+/**
+ * Least free stack seen for a task, bytes.
+ */
+void MqttManager::publishStack(const char* task, const uint16_t freeBytes) {
+    sendMessage(TOPIC_STACK, String(task) + " " + String(freeBytes));
+}
+
+/**
+ * Record is "<score> <drift> <jitter>", score 0-100 with 100 as new,
+ * drift and jitter in 0.1%.
+ */
+void MqttManager::publishHealth(const RackView_t& rs) {
+
+    if (rs.healthSeq == _healthSeq)
+        return;
+    _healthSeq = rs.healthSeq;
+
+    for (uint8_t i = 0; i < rs.fanCount; i++) {
+        const FanView_t& fan = rs.fans[i];
+        String msg = String(fan.health) + " " + String(fan.drift) + " " + String(fan.jitter);
+        sendMessage(FAN_TOPIC[i].health, msg);
+    }
+}
+
+/**
+ * State is ok, suspect, faulted or recovering; error is the last bad
+ * result code, with lifetime bad sample and fault counts.
+ */
+void MqttManager::publishFaults(const RackView_t& rs) {
+
+    if (_faultsPublished && rs.faultSeq == _faultSeq)
+        return;
+    _faultsPublished = true;
+    _faultSeq = rs.faultSeq;
+
+    for (uint8_t i = 0; i < rs.thermoCount; i++) {
+        const Fault_t& f = rs.thermos[i].fault;
+        sendMessage(THERMO_TOPIC[i].fault, String(faultStateName(f.state)) + " " +
+            String(f.lastError) + " " + String(f.errors) + " " + String(f.faults));
+    }
+    for (uint8_t i = 0; i < rs.fanCount; i++) {
+        const Fault_t& f = rs.fans[i].fault;
+        sendMessage(FAN_TOPIC[i].fault, String(faultStateName(f.state)) + " " +
+            String(f.lastError) + " " + String(f.errors) + " " + String(f.faults));
+    }
 }
 
 void MqttManager::poll() {
     _p_mqttClient->poll();
 }
 
-void MqttManager::sendMessage(const String& topic, const String& msg)
+bool MqttManager::isHistoryRequest(const String& topic) const {
+    return strcmp_P(topic.c_str(), TOPIC_HISTORY_GET) == 0;
+}
+
+bool MqttManager::isLoadHintTopic(const String& topic, String& source) const {
+    const uint8_t len = sizeof(TOPIC_LOADHINT_PRE) - 1;
+    if (strncmp_P(topic.c_str(), TOPIC_LOADHINT_PRE, len) != 0)
+        return false;
+    source = topic.substring(len);
+    return true;
+}
+
+/**
+ * Payload is "<level> <ttl>" where level is 0-100, or watts
+ * if suffixed with W, and ttl is seconds until the hint expires.
+ */
+RESULT MqttManager::parseLoadHint(const char* payload, uint8_t& level, unsigned long& ttlMs) const {
+
+    char* end;
+    long value = strtol(payload, &end, 10);
+    if (end == payload || value < 0)
+        return ERR_BAD_PARAM;
+
+    if (*end == 'W' || *end == 'w') {
+        value = (value * 100) / _loadHintFullWatts;
+        end++;
+    }
+    if (value > 100)
+        value = 100;
+
+    char* ttlEnd;
+    long ttl = strtol(end, &ttlEnd, 10);
+    if (ttlEnd == end || ttl <= 0)
+        return ERR_BAD_PARAM;
+
+    level = value;
+    ttlMs = (unsigned long)ttl * 1000;
+    return RES_OK;
+}
+
+/**
+ * The client takes topics from RAM, so copy out of flash.
+ */
+int MqttManager::beginMessage(const char* topic)
+{
+    char buf[RACK_TOPIC_LEN];
+    strncpy_P(buf, topic, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+    return _p_mqttClient->beginMessage(buf);
+}
+
+void MqttManager::sendMessage(const char* topic, const String& msg)
 {
-    _p_mqttClient->beginMessage(topic);
+    beginMessage(topic);
     _p_mqttClient->print(msg);
     if (!_p_mqttClient->endMessage())
-        Log.error(F("Failed to send message to topic %s"), topic.c_str());
+        Log.error(F("Failed to send message to topic %S"), FNAME(topic));
 }
 
 /**
  * From Print.h
- * Enables writing all log events to the topicRackLog
+ * Enables writing all log events to device/rack/log
  */
 size_t MqttManager::write(uint8_t c) {
     Serial.print(char(c));
     _buf += (char)c;
     if (c == '\n') {
         if (_p_mqttClient->connected()) {
-            _p_mqttClient->beginMessage(topicRackLog);
+            beginMessage(TOPIC_LOG);
             _p_mqttClient->print(_buf);
             _p_mqttClient->endMessage();
         }
@@ -1,6 +1,25 @@
 #include "OLEDDisplay.h"
 #include <stdlib.h>
 
+// Display layout, expanded from RackTopology.h
+typedef struct {
+    char    label[2];   // error box
+    uint8_t slot;       // temperature position, 0 left, 1 right
+} ThermoLayout_t;
+
+typedef struct {
+    uint8_t col;        // rpm % cell
+    uint8_t row;
+} FanLayout_t;
+
+#define THERMO_LAYOUT(id, name, topic, label, slot, addr) \
+    { { label, '\0' }, slot },
+#define FAN_LAYOUT(id, fanid, minRpm, maxRpm, minDuty, maxDuty, idleMw, maxMw, col, row) \
+    { col, row },
+
+static const ThermoLayout_t THERMO_LAYOUTS[THERMO_COUNT] PROGMEM = { RACK_THERMOS(THERMO_LAYOUT) };
+static const FanLayout_t    FAN_LAYOUTS[FAN_COUNT]       PROGMEM = { RACK_FANS(FAN_LAYOUT) };
+
 void OLEDDisplay::initialise() {
     _oled.begin();
     _oled.selectFont(Arial14);
@@ -44,7 +63,7 @@ void OLEDDisplay::displayOn() {
     _oled.setDisplayOn(true);
 }
 
-void OLEDDisplay::render(RackState_t&rs, const NetworkState_t& ns) {
+void OLEDDisplay::render(const RackView_t& rs, const NetworkState_t& ns) {
 
     if (!_usingIRSensor) {
         // just render if no IR sensor is configured
@@ -69,7 +88,7 @@ void OLEDDisplay::render(RackState_t&rs, const NetworkState_t& ns) {
     }
 }
 
-void OLEDDisplay::internalRender(RackState_t&rs, const NetworkState_t& ns) {
+void OLEDDisplay::internalRender(const RackView_t& rs, const NetworkState_t& ns) {
 
     if (_firstDisplay) {
         clearDisplay();
@@ -91,62 +110,51 @@ void OLEDDisplay::internalRender(RackState_t&rs, const NetworkState_t& ns) {
     _oled.drawLine(x+65, 0, x+65, 128, LINE_COL);
     _oled.drawLine(0, y-2, 128, y-2, LINE_COL);
     
+    // error boxes change only on fault transitions
+    bool drawFaults = !_faultsDrawn || rs.faultSeq != _faultSeq;
+    _faultsDrawn = true;
+    _faultSeq = rs.faultSeq;
+
     // draw temp errs
-    drawTempErrStates(rs.thermos, x+68, 128-16);
+    if (drawFaults)
+        drawTempErrStates(rs, x+68, 128-16);
 
     // draw temps
-    float fTopTemp = rs.thermos["topRack"].tempCelsuis;
-    float fBaseTemp = rs.thermos["baseRack"].tempCelsuis;
-    switch (_rotation) {
-        case SevenSegmentRender::Rotation_t::ROT_0:
-            drawFloat2_1DP(x, y, fTopTemp);
-            drawFloat2_1DP(x+66, y, fBaseTemp);
-            break;
-
-        case SevenSegmentRender::Rotation_t::ROT_90:
-            drawFloat2_1DP(x, y-67, fTopTemp);
-            drawFloat2_1DP(x+66, y-67, fBaseTemp);
-            break;
-
-        default:
-            break;
+    for (uint8_t i = 0; i < rs.thermoCount; i++) {
+        int sx = x + 66 * pgm_read_byte(&THERMO_LAYOUTS[i].slot);
+        switch (_rotation) {
+            case SevenSegmentRender::Rotation_t::ROT_0:
+                drawTemp1DP(sx, y, rs.thermos[i].tempRaw);
+                break;
+
+            case SevenSegmentRender::Rotation_t::ROT_90:
+                drawTemp1DP(sx, y-67, rs.thermos[i].tempRaw);
+                break;
+
+            default:
+                break;
+        }
     }
 
     // draw tachs
     y = y - 1 - 18;
 
-    uint8_t pc = 0;
-    switch (_rotation) {
-        case SevenSegmentRender::Rotation_t::ROT_0:
-            pc = getPercentageRPM(rs.fans[1]);
-            drawPercentage(x, y-25, pc);
-
-            pc = getPercentageRPM(rs.fans[2]);
-            drawPercentage(x, y-52, pc);
-
-            pc = getPercentageRPM(rs.fans[3]);
-            drawPercentage(x+66, y-25, pc);
-
-            pc = getPercentageRPM(rs.fans[4]);
-            drawPercentage(x+66, y-52, pc);
-            break;
-
-        case SevenSegmentRender::Rotation_t::ROT_90:
-            pc = getPercentageRPM(rs.fans[1]);
-            drawPercentage(x, y-4, pc);
-            
-            pc = getPercentageRPM(rs.fans[2]);
-            drawPercentage(x, y+23, pc);
-
-            pc = getPercentageRPM(rs.fans[3]);
-            drawPercentage(x+66, y-4, pc);
-
-            pc = getPercentageRPM(rs.fans[4]);
-            drawPercentage(x+66, y+23, pc);
-            break;
-
-        default:
-            break;
+    for (uint8_t i = 0; i < rs.fanCount; i++) {
+        uint8_t pc = getPercentageRPM(rs.fans[i]);
+        int fx = x + 66 * pgm_read_byte(&FAN_LAYOUTS[i].col);
+        int row = 27 * pgm_read_byte(&FAN_LAYOUTS[i].row);
+        switch (_rotation) {
+            case SevenSegmentRender::Rotation_t::ROT_0:
+                drawPercentage(fx, y-25-row, pc);
+                break;
+
+            case SevenSegmentRender::Rotation_t::ROT_90:
+                drawPercentage(fx, y-4+row, pc);
+                break;
+
+            default:
+                break;
+        }
     }
 
     _oled.drawLine(0, y-54, 128, y-54, LINE_COL);
@@ -154,7 +162,8 @@ void OLEDDisplay::internalRender(RackState_t&rs, const NetworkState_t& ns) {
     // draw error states: fan errors
     x = 68;
     y = y + 3;
-    drawFanErrStates(rs.fans, x, y);
+    if (drawFaults)
+        drawFanErrStates(rs, x, y);
 
     // network state
     drawNetworkState(ns, 0, 0);
@@ -167,14 +176,16 @@ void OLEDDisplay::drawNetworkState(const NetworkState_t& ns, int x, int y) {
     _oled.drawString(x, y, getIPAddressv4(ns.ethernetIP), WHITE, BLACK);
 }
 
-void OLEDDisplay::drawTempErrStates(const Thermos_t& thermos, int x, int y) {
+void OLEDDisplay::drawTempErrStates(const RackView_t& rs, int x, int y) {
 
     _oled.selectFont(System5x7);
     int w = 12;
-    for (auto it = thermos.begin(); it != thermos.end(); it++) {
-        if (it->second.result != RES_OK) {
-            _oled.drawFilledBox(x, y, x+w, y+10, RED);
-            _oled.drawString(x+4, y+2, (it->first == "topRack") ? "T" : "B", BLACK, RED);
+    for (uint8_t i = 0; i < rs.thermoCount; i++) {
+        const ThermoView_t& thermo = rs.thermos[i];
+        if (thermo.fault.state != FAULT_OK) {
+            OLED_Colour colour = getFaultColour(thermo.fault);
+            _oled.drawFilledBox(x, y, x+w, y+10, colour);
+            _oled.drawString(x+4, y+2, FNAME(THERMO_LAYOUTS[i].label), BLACK, colour);
         }
         else {
             // clear
@@ -184,14 +195,16 @@ void OLEDDisplay::drawTempErrStates(const Thermos_t& thermos, int x, int y) {
     }
 }
 
-void OLEDDisplay::drawFanErrStates(const Fans_t& fans, int x, int y) {
+void OLEDDisplay::drawFanErrStates(const RackView_t& rs, int x, int y) {
     
     _oled.selectFont(System5x7);
     int w = 12;
-    for (auto it = fans.begin(); it != fans.end(); it++) {
-        if (it->second.result != RES_OK) {
-            _oled.drawFilledBox(x, y, x+w, y+10, RED);
-            _oled.drawString(x+1, y+2, it->second.position.c_str(), BLACK, RED);
+    for (uint8_t i = 0; i < rs.fanCount; i++) {
+        const FanView_t& fan = rs.fans[i];
+        if (fan.fault.state != FAULT_OK) {
+            OLED_Colour colour = getFaultColour(fan.fault);
+            _oled.drawFilledBox(x, y, x+w, y+10, colour);
+            _oled.drawString(x+1, y+2, FNAME(fan.position), BLACK, colour);
         }
         else {
             // clear
@@ -201,13 +214,18 @@ void OLEDDisplay::drawFanErrStates(const Fans_t& fans, int x, int y) {
     }
 }
 
-uint8_t OLEDDisplay::getPercentageRPM(const FanState_t& fan) const {
-    if (fan.rpm < fan.minRpm)
+// red once faulted, yellow while suspect or recovering
+OLED_Colour OLEDDisplay::getFaultColour(const Fault_t& fault) const {
+    return (fault.state == FAULT_FAULTED) ? RED : YELLOW;
+}
+
+uint8_t OLEDDisplay::getPercentageRPM(const FanView_t& fan) const {
+    if (fan.maxRpm == 0 || fan.rpm < fan.minRpm)   // unused slot, or stopped
         return 0;
     else if (fan.rpm > fan.maxRpm)  // maybe due to "noise" on tach pin
         return 100;
     else 
-        return round( ((float)fan.rpm / fan.maxRpm) * 100 );
+        return ((uint32_t)fan.rpm * 100 + fan.maxRpm/2) / fan.maxRpm;
 }
 
 void OLEDDisplay::drawPercentage(int x, int y, uint8_t pc) {
@@ -231,15 +249,17 @@ void OLEDDisplay::drawPercentage(int x, int y, uint8_t pc) {
     _ssr.drawNumeric(x+40, y, buf[2], SevenSegmentRender::SMALL, _rotation);
 }
 
-void OLEDDisplay::drawFloat2_1DP(int x, int y, float f) {
+/**
+ * Draws raw temp (1/16 C) as dd.d
+ */
+void OLEDDisplay::drawTemp1DP(int x, int y, int16_t raw) {
 
-    if (f<0 || f>99.9) {
-        Log.error(F("Number out of bounds - %f"), f);
+    int16_t n = tempRawToTenths(raw);   // scale to int with 1DP
+    if (n<0 || n>999) {
+        Log.error(F("Number out of bounds - %d"), n);
         return; // ERR_OUT_OF_BOUNDS
     }
 
-    uint16_t n = f * 10;    // scale float with 1DP to int
-
     uint8_t buf[3];
     getDigits(n, &buf[0]);
 
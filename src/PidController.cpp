@@ -0,0 +1,59 @@
+#include "PidController.h"
+
+/**
+ * Duty limits, also bound the integrator.
+ */
+void PidController::setOutputLimits(const uint8_t minDuty, const uint8_t maxDuty) {
+    _outMin = (int32_t)minDuty << 8;
+    _outMax = (int32_t)maxDuty << 8;
+    _integ = constrain(_integ, _outMin, _outMax);
+}
+
+void PidController::reset() {
+    _integ  = _outMin;
+    _dFilt  = 0;
+    _primed = false;
+}
+
+/**
+ * Compute duty % for the measurement taken at nowMs.
+ */
+uint8_t PidController::update(const int16_t measRaw, const unsigned long nowMs) {
+
+    int16_t err = constrain(measRaw - _setpoint, -_maxErr, _maxErr);
+
+    unsigned long dt = 0;
+    if (_primed) {
+        dt = nowMs - _prevMs;
+        if (dt > _maxDtMs)
+            dt = _maxDtMs;  // eg after a long blocking call
+    }
+
+    // derivative on measurement, 1/256 C per s, low pass filtered
+    if (dt > 0) {
+        int16_t dMeas = constrain(measRaw - _prevMeas, -_maxErr, _maxErr);
+        int32_t deriv = constrain(((int32_t)dMeas * 16000) / (int32_t)dt, -32767L, 32767L);
+        _dFilt += (deriv - _dFilt) / (1 << _dShift);
+    }
+
+    int32_t p = ((int32_t)_kp * err) / 16;
+    int32_t d = ((int32_t)_kd * _dFilt) / 256;
+
+    // integrate unless already saturated in the direction of the error.
+    // 64 bit product as ki * err * dt can exceed 32 bits
+    int32_t out = p + _integ + d;
+    bool satHigh = (out >= _outMax && err > 0);
+    bool satLow  = (out <= _outMin && err < 0);
+    if (dt > 0 && !satHigh && !satLow) {
+        _integ += ((int64_t)_ki * err * (int32_t)dt) / (16L * 1000);
+        _integ = constrain(_integ, _outMin, _outMax);
+    }
+
+    out = constrain(p + _integ + d, _outMin, _outMax);
+
+    _prevMeas = measRaw;
+    _prevMs   = nowMs;
+    _primed   = true;
+
+    return (out + 128) >> 8;
+}
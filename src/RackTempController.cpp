@@ -1,61 +1,494 @@
 #include "RackTempController.h"
 #include <ArduinoLog.h>
 
+// Rack fan curve, expanded into a PROGMEM LUT at compile time.
+// Quiet below 22C, full speed from 30C.
+constexpr FanCurvePoint_t RACK_CURVE[] = {
+    { TEMP_RAW(22),  40 },
+    { TEMP_RAW(25),  55 },
+    { TEMP_RAW(28),  80 },
+    { TEMP_RAW(30), 100 }
+};
+
+uint8_t RackTempController::rackCurveLookup(const int16_t raw) {
+    return FanCurveLUT<RACK_CURVE, sizeof(RACK_CURVE)/sizeof(RACK_CURVE[0])>::lookup(raw);
+}
+
+// Device and zone tables, expanded from RackTopology.h into PROGMEM.
+// State names point into these, so are printable with FNAME().
+typedef struct {
+    char          name[RACK_NAME_LEN];
+    DeviceAddress addr;
+} ThermoSpec_t;
+
+typedef struct {
+    char     position[RACK_NAME_LEN];
+    uint16_t minRpm;
+    uint16_t maxRpm;
+    uint8_t  minDuty;
+    uint8_t  maxDuty;
+    uint16_t idleMw;
+    uint16_t maxMw;
+} FanSpec_t;
+
+typedef struct {
+    char            name[RACK_NAME_LEN];
+    uint8_t         thermos[MAX_ZONE_THERMOS];
+    uint8_t         weights[MAX_ZONE_THERMOS];
+    uint8_t         thermoCount;
+    uint8_t         fans[MAX_ZONE_FANS];
+    uint8_t         fanCount;
+    ZoneAggregate_t aggregate;
+} ZoneSpec_t;
+
+#define THERMO_SPEC(id, name, topic, label, slot, addr) \
+    { name, { RACK_LIST addr } },
+#define FAN_SPEC(id, fanid, minRpm, maxRpm, minDuty, maxDuty, idleMw, maxMw, col, row) \
+    { #id, minRpm, maxRpm, minDuty, maxDuty, idleMw, maxMw },
+#define ZONE_SPEC(id, name, aggregate, thermos, weights, fans) \
+    { name, { RACK_LIST thermos }, { RACK_LIST weights }, rackCount thermos, \
+      { RACK_LIST fans }, rackCount fans, aggregate },
+
+static const ThermoSpec_t THERMO_SPECS[THERMO_COUNT] PROGMEM = { RACK_THERMOS(THERMO_SPEC) };
+static const FanSpec_t    FAN_SPECS[FAN_COUNT]       PROGMEM = { RACK_FANS(FAN_SPEC) };
+static const ZoneSpec_t   ZONE_SPECS[ZONE_COUNT]     PROGMEM = { RACK_ZONES(ZONE_SPEC) };
+
+void RackTempController::initialise() {
+    _runHours.begin();
+    _health.begin();
+    for (uint8_t i = 0; i < STATS_THERMOS; i++)
+        _thermoAnomaly[i].setMinSd(_thermoMinSd);
+    for (uint8_t i = 0; i < FAN_COUNT; i++)
+        _fanAnomaly[i].setMinSd(_fanMinSd);
+}
+
 /**
- * Process temperatures, modify fan speed, check for errors, update trends
+ * Process temperatures, modify fan speed, check for errors, update trends.
+ * Runs each stage in turn, checking for stalls through the temperature
+ * conversion and tach window.
  */
 void RackTempController::process(RackState_t& rs) {
     
-    // read temperatures
-    readTempStates(rs.thermos);
+    // read temperatures, waiting out an async conversion here
+    requestTemps(rs);
+    if (!_tempSensors.getWaitForConversion())
+        waitCheckingStalls(rs, getConversionMs());
+    readTemps(rs);
+    checkStalls(rs);
 
     // adjust fan speeds based on temps
-    adjustFanSpeeds(rs);
+    updateFans(rs);
     
-    // read fan tach/rpms - delay of 750ms per fan
-    readFanSpeeds(rs.fans);
-
-    // verify fan PWMs matches RPMs
-    verifyFanStates(rs.fans);
+    // read fan tach/rpms - one window for all fans
+    TachSample_t sample;
+    startTach();
+    waitCheckingStalls(rs, getTachWindowMs());
+    sampleTach(sample);
+    updateTach(rs, sample);
 
     // analyse trends
-    analyseTrends(rs);
+    updateTrends(rs);
+    checkStalls(rs);
+
+    // stalls flagged since the last cycle
+    reportStalls(rs);
 };
 
+/**
+ * Waits ms, running stall checks each _stallCheckPeriodMs.
+ */
+void RackTempController::waitCheckingStalls(RackState_t& rs, const uint16_t ms) {
+
+    unsigned long start = millis();
+    for (;;) {
+        checkStalls(rs);
+        unsigned long waited = millis() - start;
+        if (waited >= ms)
+            break;
+        delay((ms - waited < _stallCheckPeriodMs) ? ms - waited : _stallCheckPeriodMs);
+    }
+}
+
+/**
+ * Set fan duties from the latest temperatures.
+ */
+void RackTempController::updateFans(RackState_t& rs) {
+    adjustFanSpeeds(rs);
+}
+
+void RackTempController::updateTrends(RackState_t& rs) {
+    analyseTrends(rs);
+}
+
+/**
+ * Logs a device's fault transition. Per cycle errors are logged at
+ * notice level, so only these reach the default log output.
+ */
+void RackTempController::reportFault(const char* name, const Fault_t& fault) {
+    _faultSeq++;
+    switch (fault.state) {
+        case FAULT_FAULTED:
+            Log.error(F("%S faulted, error %d, %d faults"), FNAME(name), fault.lastError, fault.faults);
+            break;
+        case FAULT_OK:
+            if (fault.faults > 0) {
+                Log.warning(F("%S cleared"), FNAME(name));
+                break;
+            }
+            // fall through, a suspect that never faulted
+        default:
+            Log.notice(F("%S %s"), FNAME(name), faultStateName(fault.state));
+            break;
+    }
+}
+
+/**
+ * Flags a running fan as stalled when no tach edge has arrived within
+ * _stallMarginMs of when one was due at its last measured rpm (4 edges
+ * per rev), and compensates its zone at once. Called often between
+ * stages, so a stall is caught within the period rather than at the
+ * next cycle. Nothing is logged or published here; the stall is left
+ * pending for reportStalls() at a safe point.
+ */
+void RackTempController::checkStalls(RackState_t& rs) {
+
+    unsigned long now = millis();
+    if ((now - _stallCheckMs) < _stallCheckPeriodMs)
+        return;
+    _stallCheckMs = now;
+
+    for (uint8_t i = 0; i < rs.fanCount; i++) {
+        FanState_t& fan = rs.fans[i];
+        if (fan.parked || fan.pwm == 0 || fan.rpm == 0 || fan.result != RES_OK)
+            continue;
+
+        unsigned long ageMs;
+        if (_fanControl.getTachEdgeAge(i+1, ageMs) != RES_OK)
+            continue;
+        if (ageMs <= 15000UL / fan.rpm + _stallMarginMs)
+            continue;
+
+        fan.result = ERR_FAN_NOT_OPERATIONAL;
+        fan.rpm = 0;
+        rs.degraded = true;
+        _stallPending |= 1 << i;
+        _stallAgeMs[i] = (ageMs > 0xFFFF) ? 0xFFFF : ageMs;
+        compensateStall(rs, i+1);
+    }
+}
+
+/**
+ * Logs and fault trips stalls flagged by checkStalls(). Call where
+ * logging is safe, not from within a publish or a blocking read.
+ */
+void RackTempController::reportStalls(RackState_t& rs) {
+
+    for (uint8_t i = 0; i < rs.fanCount && _stallPending; i++) {
+        if (!(_stallPending & (1 << i)))
+            continue;
+        _stallPending &= ~(1 << i);
+
+        FanState_t& fan = rs.fans[i];
+        Log.error(F("Fan %S stalled, no tach for %lms"), FNAME(fan.position), (unsigned long)_stallAgeMs[i]);
+        if (faultTrip(fan.fault, ERR_FAN_NOT_OPERATIONAL)) {
+            reportFault(fan.position, fan.fault);
+            rs.faultSeq = _faultSeq;
+        }
+    }
+}
+
+/**
+ * Immediate action on a stall, ahead of the next cycle: unpark fans
+ * and boost those sharing a zone with the stalled fan.
+ */
+void RackTempController::compensateStall(RackState_t& rs, const uint8_t fanid) {
+
+    if (_parkState != PARK_IDLE) {
+        unparkFans(rs);
+        _parkState = PARK_IDLE;
+        _parkRetryAtMs = millis() + _parkBackoffMs;
+    }
+
+    // unparked fans pick up their zone's demand, boosted where affected
+    for (uint8_t z = 0; z < rs.zoneCount; z++) {
+        Zone_t& zone = rs.zones[z];
+        bool affected = false;
+        for (uint8_t f = 0; f < zone.fanCount; f++)
+            affected |= (zone.fans[f] == fanid);
+        uint16_t target = zone.duty;
+        if (affected)
+            target = ((uint16_t)zone.duty * _failBoostPc + 50) / 100;
+
+        for (uint8_t f = 0; f < zone.fanCount; f++) {
+            FanState_t& fan = rs.fans[zone.fans[f]-1];
+            if (zone.fans[f] == fanid || fan.result != RES_OK)
+                continue;
+            uint8_t d = constrain(target, fan.minDuty, fan.maxDuty);
+            if (d > fan.pwm)
+                fan.pwm = d;
+        }
+    }
+
+    uint8_t duties[MAX_FANS] = { 0 };
+    for (uint8_t i = 0; i < rs.fanCount; i++)
+        duties[i] = rs.fans[i].parked ? 0 : rs.fans[i].pwm;
+    governPower(rs, duties, false);
+    applyTrim(rs, duties);
+    _fanControl.setPWMs(duties);
+}
+
 void RackTempController::analyseTrends(RackState_t& rs) /* const */ {
 
-    // cache RackState for trend analysis
-    cache(rs);
-    
-    float acc = 0.0;
-    uint16_t samples = 0;
+    // compact sample of this cycle for the trend ring
+    TrendSample_t sample;
+    memset(&sample, 0, sizeof(sample));
 
-    // iterate through history to accumulate temps, count samples
-    for(auto it = _rsHistory.begin(); it != _rsHistory.end(); it++) {
-        for(auto tt = it->thermos.begin(); tt != it->thermos.end(); tt++) {
-            acc += tt->second.tempCelsuis;
+    unsigned long now = millis();
+    int32_t acc = 0, ewmaAcc = 0;
+    uint8_t samples = 0;
+    for (uint8_t i = 0; i < rs.thermoCount; i++) {
+        Temperature_t& thermo = rs.thermos[i];
+        if (thermo.result == RES_OK) {
+            ewmaUpdate(thermo.trend, thermo.tempRaw, now, _ewmaTauMs);
+            acc += thermo.tempRaw;
+            ewmaAcc += ewmaRaw(thermo.trend);
             samples++;
         }
     }
-    float movingAve = (float)acc/samples;
-    Log.notice(F("Moving average temp - %F"), movingAve);
+    if (samples > 0) {
+        sample.rackRaw = (acc + (int32_t)samples/2) / samples;
+        sample.valid |= TREND_VALID(TREND_RACK);
+        rs.aveTempRaw = (ewmaAcc + (int32_t)samples/2) / samples;
+    }
+
+    for (uint8_t z = 0; z < rs.zoneCount; z++) {
+        Zone_t& zone = rs.zones[z];
+        if (zone.result != RES_OK)
+            continue;
+        ewmaUpdate(zone.trend, zone.tempRaw, now, _ewmaTauMs);
+        if (z < TREND_ZONES) {
+            sample.zoneRaw[z] = zone.tempRaw;
+            sample.valid |= TREND_VALID(TREND_RACK + 1 + z);
+        }
+    }
+
+    for (uint8_t i = 0; i < rs.fanCount; i++) {
+        sample.duty[i] = rs.fans[i].pwm;
+        sample.rpm[i]  = rs.fans[i].rpm;
+    }
+
+    _trend.push(sample);
+    accumulateStats(rs, now);
+    recordHistory(rs, now);
+    detectAnomalies(rs, now);
+    assessFanHealth(rs, now);
+
+    if (samples == 0)
+        return;
+
+    rs.riseRaw = _trend.rise(TREND_RACK);
+    char buf[8], rbuf[8];
+    Log.notice(F("Average temp - %s, rise %s"), formatTempRaw(rs.aveTempRaw, buf), formatTempRaw(rs.riseRaw, rbuf));
+
+    // per zone moving average, feeds the time of day profile
+    for (uint8_t z = 0; z < rs.zoneCount && z < TREND_ZONES; z++) {
+        Zone_t& zone = rs.zones[z];
+        uint8_t ch = TREND_RACK + 1 + z;
+        if (!_trend.mean(ch, zone.aveTempRaw))
+            continue;
+        zone.riseRaw = _trend.rise(ch);
+
+        if (_clock != NULL && _clock->isSynced())
+            _profile.update(z, _clock->minuteOfDay() / PROFILE_BUCKET_MIN, zone.aveTempRaw);
+    }
+}
+
+/**
+ * Appends a record to the compressed history every _historyPeriodMs.
+ * Unreadable thermos repeat their last value, which costs one bit.
+ * Skipped while paused for export. Records before the clock first
+ * syncs are rebased from uptime to unix time, so an export holds one
+ * timebase.
+ */
+void RackTempController::recordHistory(RackState_t& rs, const unsigned long now) {
+
+    if (_historyPaused)
+        return;
+    if (_history.getChannels() > 0 && (now - _historyMs) < _historyPeriodMs)
+        return;
+    _historyMs = now;
+
+    bool synced = _clock != NULL && _clock->isSynced();
+    if (synced && !_historyUnix) {
+        _history.rebase(timestamp(now, now) - now / 1000);
+        _historyUnix = true;
+    }
+
+    HistoryRecord_t r;
+    memset(&r, 0, sizeof(r));
+    r.t = timestamp(now, now);
+
+    uint8_t c = 0;
+    for (uint8_t i = 0; i < rs.thermoCount && c < HISTORY_CHANNELS; i++)
+        r.v[c++] = rs.thermos[i].tempRaw;
+    for (uint8_t i = 0; i < rs.fanCount && c < HISTORY_CHANNELS; i++)
+        r.v[c++] = rs.fans[i].rpm;
+
+    _history.begin(c);
+    _history.append(r);
+}
+
+/**
+ * Seconds for a millis() time, unix time once the clock syncs
+ * otherwise uptime.
+ */
+uint32_t RackTempController::timestamp(const unsigned long ms, const unsigned long now) const {
+    if (_clock != NULL && _clock->isSynced())
+        return _clock->now() - (now - ms) / 1000;
+    return ms / 1000;
+}
+
+/**
+ * Streaming change detection on each thermo temperature and on each
+ * fan's rpm as a proportion of that expected at its applied duty, so a
+ * fan losing a few % or a slowly warming sensor is caught well inside
+ * the static bands. Fans that are parked, failed or below minDuty are
+ * not sampled.
+ */
+void RackTempController::detectAnomalies(RackState_t& rs, const unsigned long now) {
+
+    for (uint8_t i = 0; i < rs.thermoCount; i++) {
+        Temperature_t& thermo = rs.thermos[i];
+        if (thermo.result != RES_OK)
+            continue;
+        AnomalyKind_t kind = _thermoAnomaly[i].update(thermo.tempRaw, now);
+        if (kind != ANOMALY_NONE)
+            raiseAnomaly(rs, thermo.name, false, kind, _thermoAnomaly[i], now);
+    }
+
+    for (uint8_t i = 0; i < rs.fanCount; i++) {
+        FanState_t& fan = rs.fans[i];
+        uint16_t ratio = rpmRatio(fan);
+        if (ratio == 0)
+            continue;
+
+        AnomalyDetector& detector = _fanAnomaly[i];
+        AnomalyKind_t kind = detector.update(ratio, now);
+        if (kind != ANOMALY_NONE)
+            raiseAnomaly(rs, fan.position, true, kind, detector, now);
+    }
+}
+
+/**
+ * Fan rpm as 0.1% of that expected at the applied (trimmed) duty, on the
+ * fan's own duty to rpm line from minRpm at minDuty to maxRpm at 100%.
+ * Fans have an rpm offset, so a line through zero would move the ratio
+ * with every change of duty. 0 for fans that are parked, failed or
+ * below minDuty.
+ */
+uint16_t RackTempController::rpmRatio(const FanState_t& fan) const {
 
-    rs.aveTempCelsius = movingAve;
-    //rs.trend.movingAveTempCelsuis = movingAve;
-    //rs.trend.accFanError =   
+    if (fan.parked || fan.spinUp || fan.result != RES_OK || fan.pwm < fan.minDuty)
+        return 0;
+
+    int32_t applied = (int32_t)fan.pwm * 16 + (_rpmTrimEnabled ? fan.trim : 0);
+    int32_t expected = expectedRpm(fan, applied);
+    if (expected <= 0)
+        return 0;
+    int32_t ratio = ((int32_t)fan.rpm * 1000) / expected;
+    return constrain(ratio, 1L, 32767L);
 }
 
 /**
- * Maintains FIFO queue. Not using queue STL 
- * as it doesn't provide iterator.
+ * Rpm expected of a fan at duty16 (1/16 %), on its line from minRpm at
+ * minDuty to maxRpm at 100%. The one reference the rpm trim steers to
+ * and the rpm check, anomaly ratio and health are judged against.
  */
-void RackTempController::cache(const RackState_t& rs) {
+int32_t RackTempController::expectedRpm(const FanState_t& fan, const int32_t duty16) const {
+    if (fan.minDuty >= 100)
+        return fan.maxRpm;
+    int32_t span = (int32_t)(100 - fan.minDuty) * 16;
+    return fan.minRpm + ((int32_t)(fan.maxRpm - fan.minRpm) * (duty16 - fan.minDuty * 16)) / span;
+}
+
+/**
+ * Feeds running fans' rpm ratio and tach jitter to FanHealth and
+ * copies out the scores as they refresh.
+ */
+void RackTempController::assessFanHealth(RackState_t& rs, const unsigned long now) {
+
+    for (uint8_t i = 0; i < rs.fanCount; i++) {
+        FanState_t& fan = rs.fans[i];
+        uint16_t ratio = rpmRatio(fan);
+        if (ratio == 0)
+            continue;
+        int16_t trim = _rpmTrimEnabled ? fan.trim : 0;
+        uint8_t duty = ((int16_t)fan.pwm * 16 + trim + 8) / 16;
+        _health.sample(i+1, duty, ratio, fan.jitter);
+    }
+
+    if (!_health.maintain(now))
+        return;
+
+    for (uint8_t i = 0; i < rs.fanCount; i++) {
+        FanState_t& fan = rs.fans[i];
+        fan.health = _health.getScore(i+1);
+        fan.drift = _health.getDrift(i+1);
+        if (fan.health < 60)
+            Log.warning(F("Fan %S health %d, drift %d, jitter %d"), FNAME(fan.position),
+                fan.health, fan.drift, fan.jitter);
+    }
+    rs.healthSeq++;
+}
+
+void RackTempController::raiseAnomaly(RackState_t& rs, const char* signal, const bool fan,
+    const AnomalyKind_t kind, const AnomalyDetector& detector, const unsigned long now) {
+
+    Log.warning(F("Anomaly %d on %S, deviation %d"), kind, FNAME(signal), detector.getDeviation());
+
+    // keep the latest if not drained
+    if (rs.anomalyCount == MAX_ANOMALY_EVENTS) {
+        for (uint8_t i = 1; i < MAX_ANOMALY_EVENTS; i++)
+            rs.anomalies[i-1] = rs.anomalies[i];
+        rs.anomalyCount--;
+    }
+
+    AnomalyEvent_t& e = rs.anomalies[rs.anomalyCount++];
+    e.signal = signal;
+    e.fan = fan;
+    e.kind = kind;
+    e.magnitude = detector.getDeviation();
+    e.onset = timestamp(detector.getOnsetMs(), now);
+}
+
+/**
+ * Streams this cycle into the interval statistics, and on closing an
+ * interval summarises it into rs.stats for publishing.
+ */
+void RackTempController::accumulateStats(RackState_t& rs, const unsigned long now) {
+
+    uint8_t i;
+    for (i = 0; i < rs.thermoCount; i++) {
+        if (rs.thermos[i].result == RES_OK)
+            _thermoStats[i].add(rs.thermos[i].tempRaw);
+    }
+    for (i = 0; i < rs.fanCount && i < STATS_FANS; i++)
+        _dutyStats[i].add(rs.fans[i].pwm);
+
+    if ((now - _statsStartMs) < _statsIntervalMs)
+        return;
 
-    _rsHistory.push_back(rs);
-    if (_rsHistory.size() > _historyDepth) {
-        _rsHistory.pop_front();
+    for (i = 0; i < STATS_THERMOS; i++) {
+        _thermoStats[i].summarise(rs.stats.thermos[i]);
+        _thermoStats[i].reset();
     }
-    Log.notice(F("history queue size %d"), _rsHistory.size());
+    for (i = 0; i < STATS_FANS; i++) {
+        _dutyStats[i].summarise(rs.stats.duty[i]);
+        _dutyStats[i].reset();
+    }
+    rs.stats.seq++;
+    _statsStartMs = now;
+    Log.notice(F("Statistics interval %d closed"), rs.stats.seq);
 }
 
 /**
@@ -65,27 +498,40 @@ void RackTempController::cache(const RackState_t& rs) {
  */
 RESULT RackTempController::checkRpm(FanState_t& fs) const {
 
+    uint16_t variance = ((uint32_t)fs.maxRpm * _rpmVariance + 50) / 100;
+
+    // parked fans should stop, although some PWM fans idle at minimum speed at 0%
+    if (fs.parked) {
+        if (fs.rpm > fs.minRpm + variance) {
+            fs.result = ERR_FAN_TACH;
+            Log.notice(F("Parked fan %S is spinning at %d rpm"), FNAME(fs.position), fs.rpm);
+            return ERR_FAN_TACH;
+        }
+        fs.result = RES_OK;
+        return RES_OK;
+    }
+
     // is fan spinning at all?
     if (fs.minRpm > 0 && fs.rpm < fs.minRpm) {
         fs.result = ERR_FAN_NOT_OPERATIONAL;
-        Log.error(F("Fan %s is not operational"), fs.position.c_str());
+        Log.notice(F("Fan %S is not operational"), FNAME(fs.position));
         return ERR_FAN_NOT_OPERATIONAL;
     }
 
     // is the fan within expected RPM variance given dutyCycle?
-    uint16_t expectedRpm = round( fs.maxRpm * (float)fs.pwm/100 );
+    int32_t expected = expectedRpm(fs, (int32_t)fs.pwm * 16);
    
-    int16_t r = round(expectedRpm - fs.maxRpm * _rpmVariance);
+    int32_t r = expected - variance;
     uint16_t minExpectedRpm = (r<0) ? 0 : r;
-    uint16_t maxExpectedRpm = round(expectedRpm + fs.maxRpm * _rpmVariance);
+    uint16_t maxExpectedRpm = constrain(expected + variance, 0L, 65535L);
 
     // if rpm is out of range of expectated rpm
     if (fs.rpm < minExpectedRpm || fs.rpm > maxExpectedRpm)
     {
         /* if (fs.rpm > fs.maxRpm) {
             // assume this is NOT an error condition - perhaps tach noise or manufacture issue?
-            Log.warning(F("Fan %s is spinning at %d rpm, which is faster than maxRpm: %d"), 
-                fs.position.c_str(),
+            Log.warning(F("Fan %S is spinning at %d rpm, which is faster than maxRpm: %d"), 
+                FNAME(fs.position),
                 fs.rpm,
                 fs.maxRpm);
         }
@@ -93,8 +539,8 @@ RESULT RackTempController::checkRpm(FanState_t& fs) const {
         {
             // we are out of range
             fs.result = ERR_FAN_TACH;
-            Log.error(F("Rpm of fan %s is out of range: %d is not between %d to %d"), 
-                fs.position.c_str(),
+            Log.notice(F("Rpm of fan %S is out of range: %d is not between %d to %d"), 
+                FNAME(fs.position),
                 fs.rpm,
                 minExpectedRpm,
                 maxExpectedRpm);
@@ -102,91 +548,876 @@ RESULT RackTempController::checkRpm(FanState_t& fs) const {
         }
     }
 
+    fs.result = RES_OK;
     return RES_OK;
 }
 
 /**
  * Verify fan state: speed
+ * Returns number of fans not operational.
  */
-void RackTempController::verifyFanStates(Fans_t& fans) const {
-    for (auto it = fans.begin(); it != fans.end(); it++) {
-        checkRpm(it->second);
+uint8_t RackTempController::verifyFanStates(RackState_t& rs) {
+    uint8_t failed = 0;
+    unsigned long now = millis();
+    for (uint8_t i = 0; i < rs.fanCount; i++) {
+        FanState_t& fan = rs.fans[i];
+        if (fan.spinUp && (now - fan.spinUpMs) >= _spinUpGraceMs)
+            fan.spinUp = false;
+
+        RESULT res = checkRpm(fan);
+        if (fan.spinUp && res != RES_OK)
+            fan.result = RES_OK;    // still spinning up, neither compensated nor counted to a fault
+        else if (faultUpdate(fan.fault, res, _fanFault))
+            reportFault(fan.position, fan.fault);
+        if (isFaulted(fan.fault) && fan.fault.lastError == ERR_FAN_NOT_OPERATIONAL)
+            failed++;
     }
+    return failed;
 }
 
+/**
+ * Each zone aggregates its thermos and runs its own PID or fan curve.
+ * PID output limits span the zone's fans so anti-windup sees true
+ * saturation, then each fan is clamped to its own minDuty/maxDuty and
+ * all fans are updated in one batch.
+ *
+ * Fans marked not operational by the last verify are compensated for:
+ * the surviving fans in the same zone are boosted by _failBoostPc, and
+ * the failed fan gets a full duty spin-up kick every _kickIntervalMs.
+ * A fan whose pwm rises from 0, e.g. unparked, is given _spinUpGraceMs
+ * to reach speed before its rpm can mark it not operational.
+ */
 void RackTempController::adjustFanSpeeds(RackState_t& rs) {
 
-    // Basic rule: any thermo above threshold temp, set it to full spin
-    // else run it at half speed.
-    uint8_t dutyCycle = 50;
-    for (auto it = rs.thermos.begin(); it != rs.thermos.end(); it++) {
-        Temperature_t& thermo = it->second;
-        if (thermo.tempCelsuis > _TEMP_THRESHOLD) {
-            dutyCycle = 100;
+    uint8_t duties[MAX_FANS] = { 0 };
+    unsigned long now = millis();
+
+    // run hours for wear levelling, over the period at the previous duties
+    for (uint8_t i = 0; i < rs.fanCount; i++) {
+        if (rs.fans[i].pwm > 0)
+            _runHours.accumulate(i+1, now - _lastAdjustMs);
+    }
+    _runHours.maintain(now);
+    _lastAdjustMs = now;
+
+    rs.loadHint = activeLoadHint();
+    uint8_t ff = ((uint16_t)rs.loadHint * _loadFeedForward + 50) / 100;
+
+    for (uint8_t z = 0; z < rs.zoneCount; z++) {
+        Zone_t& zone = rs.zones[z];
+
+        uint8_t minDuty = MAX_DUTY_CYCLE;
+        uint8_t maxDuty = MIN_DUTY_CYCLE;
+        for (uint8_t f = 0; f < zone.fanCount; f++) {
+            FanState_t& fan = rs.fans[zone.fans[f]-1];
+            if (fan.minDuty < minDuty)
+                minDuty = fan.minDuty;
+            if (fan.maxDuty > maxDuty)
+                maxDuty = fan.maxDuty;
+        }
+
+        ZoneControl_t& zc = _zoneControl[z];
+        zc.pid.setSetpoint(_setpoint);
+        zc.pid.setOutputLimits(minDuty, maxDuty);
+
+        zone.result = aggregateZone(zone, rs.thermos);
+        if (zone.result == RES_OK) {
+            bool modelled = _controlMode == CONTROL_MPC && zc.model.isValid();
+            if (zc.modelled && !modelled)
+                zc.pid.reset();     // integrator is stale from before the model took over
+            zc.modelled = modelled;
+
+            if (_controlMode == CONTROL_CURVE)
+                zone.duty = zc.curve.update(zone.tempRaw, now);
+            else if (modelled)
+                zone.duty = zc.model.chooseDuty(zone.tempRaw, _setpoint, minDuty, maxDuty);
+            else
+                zone.duty = zc.pid.update(zone.tempRaw, now);
+
+            // raise the floor ahead of historically hot periods
+            uint8_t baseline = profileFloor(z, minDuty, maxDuty);
+            if (zone.duty < baseline)
+                zone.duty = baseline;
+
+            // pre-cool ahead of expected load
+            if (ff > 0) {
+                uint16_t d = zone.duty + ff;
+                zone.duty = (d > maxDuty) ? maxDuty : d;
+            }
+        }
+        else {
+            // no temperatures - fail safe to full cooling
+            Log.warning(F("No thermos readable in zone %S, fans to max"), FNAME(zone.name));
+            zone.duty = MAX_DUTY_CYCLE;
+            zc.pid.reset();
         }
+
+        uint8_t failed = 0;
+        for (uint8_t f = 0; f < zone.fanCount; f++) {
+            if (rs.fans[zone.fans[f]-1].result == ERR_FAN_NOT_OPERATIONAL)
+                failed++;
+        }
+        uint16_t boosted = zone.duty;
+        if (failed > 0 && failed < zone.fanCount) {
+            boosted = ((uint16_t)zone.duty * _failBoostPc + 50) / 100;
+            if (boosted > MAX_DUTY_CYCLE)
+                boosted = MAX_DUTY_CYCLE;
+        }
+
+        // a fan shared by zones takes the highest demand
+        for (uint8_t f = 0; f < zone.fanCount; f++) {
+            uint8_t i = zone.fans[f]-1;
+            uint8_t d = (rs.fans[i].result == ERR_FAN_NOT_OPERATIONAL) ? zone.duty : boosted;
+            if (d > duties[i])
+                duties[i] = d;
+        }
+        Log.notice(F("Zone %S pwm demand - %d"), FNAME(zone.name), zone.duty);
     }
 
+    updateParking(rs, now);
+
     // update fan speed and state
-    _fanControl.setPWMForAll(dutyCycle);
-    for (auto it = rs.fans.begin(); it != rs.fans.end(); it++) {
-        it->second.pwm = dutyCycle;
+    for (uint8_t i = 0; i < rs.fanCount; i++) {
+        FanState_t& fan = rs.fans[i];
+        uint8_t prev = fan.pwm;
+        fan.pwm = constrain(duties[i], fan.minDuty, fan.maxDuty);
+        if (fan.result == ERR_FAN_NOT_OPERATIONAL && (now - fan.lastKickMs) >= _kickIntervalMs) {
+            Log.warning(F("Spin-up kick for fan %S"), FNAME(fan.position));
+            fan.pwm = MAX_DUTY_CYCLE;
+            fan.lastKickMs = now;
+        }
+        if (fan.parked)
+            fan.pwm = 0;
+        if (prev == 0 && fan.pwm > 0) {
+            fan.spinUp = true;
+            fan.spinUpMs = now;
+        }
+        duties[i] = fan.pwm;
     }
 
-    Log.notice(F("Fan's pwm set at - %d"), dutyCycle);
+    governPower(rs, duties);
+    applyTrim(rs, duties);
+    _fanControl.setPWMs(duties);
+
+    // identify each model from the mean duty its zone's fans run at until
+    // next cycle, after compensation, parking, the governor and trim
+    for (uint8_t z = 0; z < rs.zoneCount; z++) {
+        const Zone_t& zone = rs.zones[z];
+        if (zone.result != RES_OK || zone.fanCount == 0)
+            continue;
+        uint16_t sum = 0;
+        for (uint8_t f = 0; f < zone.fanCount; f++)
+            sum += duties[zone.fans[f]-1];
+        _zoneControl[z].model.update(zone.tempRaw, (sum + zone.fanCount/2) / zone.fanCount, now);
+    }
 }
 
 /**
- * Get tach/rpm for all fans
- * Delay of 750ms per fan within getRPM()
+ * Inner rpm loop, run on each tach sample. Fans of one model differ
+ * by ~10% rpm at the same duty, so each healthy fan's duty is trimmed
+ * by an integral term until its rpm matches expectedRpm() at its pwm.
+ * Integer only; the trim is bounded by _rpmTrimLimit and the fan's duty
+ * range, and applyTrim() holds the trimmed duties within the budget.
  */
-void RackTempController::readFanSpeeds(Fans_t& fans) {
-    
-    uint16_t rpm = 0;
-    
+void RackTempController::trimFanSpeeds(RackState_t& rs) {
+
+    uint8_t duties[MAX_FANS] = { 0 };
+
+    for (uint8_t i = 0; i < rs.fanCount; i++) {
+        FanState_t& fan = rs.fans[i];
+        duties[i] = fan.pwm;
+
+        if (fan.parked || fan.spinUp || fan.result != RES_OK || fan.pwm < fan.minDuty || fan.maxRpm == 0) {
+            fan.trim = 0;
+            continue;
+        }
+
+        int32_t target = expectedRpm(fan, (int32_t)fan.pwm * 16);
+        int32_t error = target - fan.rpm;
+        if (error > -_rpmTrimDeadband && error < _rpmTrimDeadband)
+            continue;
+
+        int32_t trim = fan.trim + (error * 100 * _rpmTrimGain) / fan.maxRpm;
+
+        // anti-windup: hold within the limit and the fan's duty range
+        int32_t hi = (int32_t)(fan.maxDuty - fan.pwm) * 16;
+        int32_t lo = -(int32_t)(fan.pwm - fan.minDuty) * 16;
+        if (hi > _rpmTrimLimit * 16)
+            hi = _rpmTrimLimit * 16;
+        if (lo < -_rpmTrimLimit * 16)
+            lo = -_rpmTrimLimit * 16;
+        fan.trim = constrain(trim, lo, hi);
+    }
+
+    applyTrim(rs, duties);
+    _fanControl.setPWMs(duties);
+}
+
+/**
+ * Add each fan's rpm trim to its duty. Trims may only raise duty while
+ * the governor is not limiting and the trimmed duties stay within the
+ * PoE budget, so the governor's cap holds after trimming.
+ */
+void RackTempController::applyTrim(RackState_t& rs, uint8_t* duties) const {
+
+    if (!_rpmTrimEnabled)
+        return;
+
+    uint8_t trimmed[MAX_FANS];
+    bool raise = !_powerLimited;
+    for (;;) {
+        memcpy(trimmed, duties, rs.fanCount);
+        for (uint8_t i = 0; i < rs.fanCount; i++) {
+            const FanState_t& fan = rs.fans[i];
+            if (fan.parked || fan.pwm < fan.minDuty)
+                continue;
+
+            int16_t trim = fan.trim;
+            if (!raise && trim > 0)
+                trim = 0;
+            int16_t d = fan.pwm + (trim + ((trim > 0) ? 8 : -8)) / 16;
+            trimmed[i] = constrain(d, fan.minDuty, fan.maxDuty);
+        }
+        if (!raise || fanDemandMw(rs, trimmed) <= fanBudgetMw())
+            break;
+        raise = false;
+    }
+    memcpy(duties, trimmed, rs.fanCount);
+}
+
+/**
+ * Low load fan parking. After _parkAfterMs with every zone at or near
+ * its minimum duty, one fan per multi-fan zone is parked - the one with
+ * most run hours. A trial then confirms each zone holds temperature
+ * before parking commits; a failed trial backs off. Once committed the
+ * parked fans are re-picked every _parkRotateMs to even out bearing
+ * hours, and any rise in demand unparks immediately.
+ */
+void RackTempController::updateParking(RackState_t& rs, const unsigned long now) {
+
+    if (!_parkingEnabled) {
+        if (_parkState != PARK_IDLE) {
+            unparkFans(rs);
+            _parkState = PARK_IDLE;
+        }
+        return;
+    }
+
+    bool lowLoad = !rs.degraded && rs.loadHint == 0;
+    bool warmed = false;
+    for (uint8_t z = 0; z < rs.zoneCount; z++) {
+        Zone_t& zone = rs.zones[z];
+        uint8_t minDuty = MAX_DUTY_CYCLE;
+        for (uint8_t f = 0; f < zone.fanCount; f++) {
+            if (rs.fans[zone.fans[f]-1].minDuty < minDuty)
+                minDuty = rs.fans[zone.fans[f]-1].minDuty;
+        }
+        if (zone.result != RES_OK || zone.duty > minDuty + _parkMargin)
+            lowLoad = false;
+        if (_parkState == PARK_TRIAL && zone.tempRaw - _zoneControl[z].parkStartRaw > _parkMaxRise)
+            warmed = true;
+    }
+    if (!lowLoad)
+        _lowLoadSinceMs = now;
+
+    switch (_parkState) {
+        case PARK_IDLE:
+            if (lowLoad && (now - _lowLoadSinceMs) >= _parkAfterMs &&
+                (long)(now - _parkRetryAtMs) >= 0 && parkFans(rs)) {
+                for (uint8_t z = 0; z < rs.zoneCount; z++)
+                    _zoneControl[z].parkStartRaw = rs.zones[z].tempRaw;
+                _parkState = PARK_TRIAL;
+                _parkStateMs = now;
+                Log.notice(F("Fans parked, verifying"));
+            }
+            break;
+
+        case PARK_TRIAL:
+            if (!lowLoad || warmed) {
+                unparkFans(rs);
+                _parkState = PARK_IDLE;
+                _parkRetryAtMs = now + _parkBackoffMs;
+                Log.warning(F("Parking trial failed, backing off"));
+            }
+            else if ((now - _parkStateMs) >= _parkTrialMs) {
+                _parkState = PARK_COMMITTED;
+                _parkStateMs = now;
+                Log.notice(F("Fan parking committed"));
+            }
+            break;
+
+        case PARK_COMMITTED:
+            if (!lowLoad) {
+                unparkFans(rs);
+                _parkState = PARK_IDLE;
+                Log.notice(F("Load increased, fans unparked"));
+            }
+            else if ((now - _parkStateMs) >= _parkRotateMs) {
+                // rotate: re-pick by run hours and verify the new layout
+                unparkFans(rs);
+                _parkState = PARK_IDLE;
+                if (parkFans(rs)) {
+                    _parkState = PARK_TRIAL;
+                    _parkStateMs = now;
+                }
+            }
+            break;
+    }
+}
+
+/**
+ * Park the healthy fan with most run hours in each zone of two or
+ * more fans. Returns true if any fan was parked.
+ */
+bool RackTempController::parkFans(RackState_t& rs) {
+
+    bool parked = false;
+    for (uint8_t z = 0; z < rs.zoneCount; z++) {
+        Zone_t& zone = rs.zones[z];
+        if (zone.fanCount < 2)
+            continue;
+
+        int16_t pick = -1;
+        uint8_t running = 0;
+        for (uint8_t f = 0; f < zone.fanCount; f++) {
+            uint8_t fanid = zone.fans[f];
+            FanState_t& fan = rs.fans[fanid-1];
+            if (fan.result != RES_OK || fan.parked)
+                continue;
+            running++;
+            if (pick < 0 || _runHours.getMinutes(fanid) > _runHours.getMinutes(pick))
+                pick = fanid;
+        }
+
+        // keep at least one healthy fan running in the zone
+        if (pick > 0 && running >= 2) {
+            rs.fans[pick-1].parked = true;
+            parked = true;
+            Log.notice(F("Parking fan %S, %l run minutes"), FNAME(rs.fans[pick-1].position), _runHours.getMinutes(pick));
+        }
+    }
+    return parked;
+}
+
+void RackTempController::unparkFans(RackState_t& rs) {
+    for (uint8_t i = 0; i < rs.fanCount; i++)
+        rs.fans[i].parked = false;
+}
+
+/**
+ * Estimated fan draw: idle plus the cube law share of the range
+ * (fan affinity laws). Zero when not driven.
+ */
+uint16_t RackTempController::fanPowerMw(const FanState_t& fan, const uint8_t duty) const {
+    if (duty == 0)
+        return 0;
+    uint32_t d3 = ((uint32_t)duty * duty * duty) / 1000;   // 0-1000
+    return fan.idleMw + ((uint32_t)(fan.maxMw - fan.idleMw) * d3) / 1000;
+}
+
+uint32_t RackTempController::fanDemandMw(const RackState_t& rs, const uint8_t* duties) const {
+    uint32_t demand = 0;
+    for (uint8_t i = 0; i < rs.fanCount; i++)
+        demand += fanPowerMw(rs.fans[i], duties[i]);
+    return demand;
+}
+
+// PoE budget left for the fans after the base load
+uint16_t RackTempController::fanBudgetMw() const {
+    return (_powerBudgetMw > _baseLoadMw) ? _powerBudgetMw - _baseLoadMw : 0;
+}
+
+/**
+ * Keep estimated total draw under the PoE budget. If demand exceeds it
+ * every fan drops to its minDuty, then the headroom is handed back a
+ * zone at a time, hottest zone (relative to setpoint) first.
+ */
+void RackTempController::governPower(RackState_t& rs, uint8_t* duties, const bool report) {
+
+    uint16_t fanBudget = fanBudgetMw();
+    uint32_t demand = fanDemandMw(rs, duties);
+
+    // set on the demand, powerUtil truncates so may read under 100 when limited
+    _powerLimited = demand > fanBudget;
+    if (_powerLimited) {
+        if (report)
+            Log.warning(F("Fan demand %lmW over budget %dmW"), demand, fanBudget);
+
+        uint8_t requested[MAX_FANS];
+        memcpy(requested, duties, MAX_FANS);
+
+        uint32_t draw = 0;
+        for (uint8_t i = 0; i < rs.fanCount; i++) {
+            uint8_t d = (requested[i] < rs.fans[i].minDuty) ? requested[i] : rs.fans[i].minDuty;
+            duties[i] = d;
+            draw += fanPowerMw(rs.fans[i], d);
+        }
+
+        // hand out headroom hottest zone first
+        bool done[MAX_ZONES] = { false };
+        for (uint8_t n = 0; n < rs.zoneCount; n++) {
+            uint8_t hottest = 0;
+            int16_t excess = 0;
+            bool found = false;
+            for (uint8_t z = 0; z < rs.zoneCount; z++) {
+                int16_t e = rs.zones[z].tempRaw - _setpoint;
+                if (!done[z] && (!found || e > excess)) {
+                    hottest = z;
+                    excess = e;
+                    found = true;
+                }
+            }
+            done[hottest] = true;
+
+            const Zone_t& zone = rs.zones[hottest];
+            for (uint8_t f = 0; f < zone.fanCount; f++) {
+                uint8_t i = zone.fans[f]-1;
+                FanState_t& fan = rs.fans[i];
+                uint8_t cur = duties[i];
+                uint16_t curMw = fanPowerMw(fan, cur);
+                uint8_t d = requested[i];
+                // highest duty up to requested that fits the headroom
+                while (d > cur && draw - curMw + fanPowerMw(fan, d) > fanBudget)
+                    d--;
+                draw += fanPowerMw(fan, d) - curMw;
+                duties[i] = d;
+            }
+        }
+
+        for (uint8_t i = 0; i < rs.fanCount; i++)
+            rs.fans[i].pwm = duties[i];
+        demand = draw;
+    }
+
+    rs.powerUtil = ((demand + _baseLoadMw) * 100) / _powerBudgetMw;
+}
+
+/**
+ * Baseline duty for zone z from the largest rise learned for the next
+ * _profileLookahead buckets. minDuty if no clock or nothing notable.
+ */
+uint8_t RackTempController::profileFloor(const uint8_t z, const uint8_t minDuty, const uint8_t maxDuty) const {
+
+    if (_clock == NULL || !_clock->isSynced())
+        return minDuty;
+
+    uint8_t bucket = _clock->minuteOfDay() / PROFILE_BUCKET_MIN;
+    int8_t rise = 0;
+    for (uint8_t i = 1; i <= _profileLookahead; i++) {
+        int8_t r = _profile.expectedRise(z, bucket + i);
+        if (r > rise)
+            rise = r;
+    }
+    if (rise < _profileMinRise)
+        return minDuty;
+
+    uint16_t baseline = minDuty + (uint16_t)rise * _profileGain;
+    return (baseline > maxDuty) ? maxDuty : baseline;
+}
+
+/**
+ * Record a host's load hint, replacing any previous hint from the same
+ * host, else the first free or expired slot.
+ */
+void RackTempController::setLoadHint(const char* source, const uint8_t level, const unsigned long ttlMs) {
+
+    unsigned long now = millis();
+    int8_t slot = -1;
+    for (uint8_t i = 0; i < MAX_LOAD_HINTS; i++) {
+        if (strncmp(_loadHints[i].source, source, LOAD_HINT_SOURCE - 1) == 0) {
+            slot = i;
+            break;
+        }
+        if (slot < 0 && (_loadHints[i].source[0] == '\0' || (long)(now - _loadHints[i].expiresMs) >= 0))
+            slot = i;
+    }
+    if (slot < 0) {
+        Log.warning(F("No slot for load hint from %s"), source);
+        return;
+    }
+
+    strncpy(_loadHints[slot].source, source, LOAD_HINT_SOURCE - 1);
+    _loadHints[slot].source[LOAD_HINT_SOURCE - 1] = '\0';
+    _loadHints[slot].level     = (level > 100) ? 100 : level;
+    _loadHints[slot].expiresMs = now + ttlMs;
+    Log.notice(F("Load hint %s - %d for %lms"), source, level, ttlMs);
+}
+
+/**
+ * Sum of unexpired hints, capped at 100.
+ */
+uint8_t RackTempController::activeLoadHint() {
+
+    unsigned long now = millis();
+    uint16_t level = 0;
+    for (uint8_t i = 0; i < MAX_LOAD_HINTS; i++) {
+        if (_loadHints[i].source[0] == '\0')
+            continue;
+        if ((long)(now - _loadHints[i].expiresMs) >= 0) {
+            _loadHints[i].source[0] = '\0';
+            continue;
+        }
+        level += _loadHints[i].level;
+    }
+    return (level > 100) ? 100 : level;
+}
+
+/**
+ * Combine the zone's readable thermos into zone.tempRaw.
+ * ERR_FAILED_TO_READ_TEMP if none could be read.
+ */
+RESULT RackTempController::aggregateZone(Zone_t& zone, const Temperature_t* thermos) const {
+
+    bool found = false;
+    int32_t acc = 0;
+    uint16_t weights = 0;
+    int16_t hottest = 0;
+
+    for (uint8_t i = 0; i < zone.thermoCount; i++) {
+        const Temperature_t& thermo = thermos[zone.thermos[i]];
+        if (thermo.result != RES_OK)
+            continue;
+
+        int16_t t = thermo.tempRaw;
+        uint8_t w = zone.weights[i];
+        acc += (int32_t)t * w;
+        weights += w;
+        if (!found || t > hottest)
+            hottest = t;
+        found = true;
+    }
+
+    if (!found)
+        return ERR_FAILED_TO_READ_TEMP;
+
+    if (zone.aggregate == AGG_WEIGHTED_MEAN && weights > 0)
+        zone.tempRaw = (acc + (int32_t)weights/2) / weights;
+    else
+        zone.tempRaw = hottest;
+    return RES_OK;
+}
+
+/**
+ * Opens the tach window shared by all fans, close it with sampleTach()
+ * after getTachWindowMs(). Neither reads rack state, so the pair may
+ * run in its own task, sleeping through the window.
+ */
+void RackTempController::startTach() {
+    _fanControl.startRPMs();
+}
+
+/**
+ * Rpm and tach jitter of all fans, over the window since startTach().
+ */
+void RackTempController::sampleTach(TachSample_t& sample) {
+
+    memset(&sample, 0, sizeof(sample));
+
     Log.notice(F("Reading fan rpms"));
 
-    for (auto it = fans.begin(); it != fans.end(); it++) {
-        _fanControl.getRPM(it->first, rpm);
-        it->second.rpm = rpm;
-        Log.notice(F("Fan %s rpm - %d"), it->second.position.c_str(), rpm);
+    RESULT res = _fanControl.getRPMs(sample.rpm);
+    if (res != RES_OK)
+        Log.warning(F("Fan rpms not read - %d"), res);
+    for (uint8_t i = 0; i < FAN_COUNT; i++)
+        _fanControl.getTachJitter(i+1, sample.jitter[i]);
+}
+
+/**
+ * Store a tach sample then trim and verify fans against it,
+ * degraded while any fan is faulted.
+ */
+void RackTempController::updateTach(RackState_t& rs, const TachSample_t& sample) {
+
+    for (uint8_t i = 0; i < rs.fanCount; i++) {
+        FanState_t& fan = rs.fans[i];
+        fan.rpm = sample.rpm[i];
+        fan.jitter = sample.jitter[i];
+        Log.notice(F("Fan %S rpm - %d"), FNAME(fan.position), fan.rpm);
     }
-};
 
-void RackTempController::readTempStates(Thermos_t& thermos) {
+    if (_rpmTrimEnabled)
+        trimFanSpeeds(rs);
 
-    // Initialise sensors each read incase new sensors are added/removed.
-    _tempSensors.begin();
+    bool degraded = verifyFanStates(rs) > 0;
+    if (degraded != rs.degraded) {
+        if (degraded)
+            Log.error(F("Fan failure, rack cooling degraded"));
+        else
+            Log.notice(F("All fans operational"));
+        rs.degraded = degraded;
+    }
+    rs.faultSeq = _faultSeq;
+}
 
-    // useful for new thermo's to get deviceAddress
-    //  searchAndPrintAddresses();
-    
-    // Iterate through all devices ensuring they are still connected
-    for (auto it = thermos.begin(); it != thermos.end(); it++) {
-        Temperature_t& thermo = it->second;
-        if (!_tempSensors.isConnected(thermo.addr)) {
-            Log.warning(F("Unable to find thermometer %s"), it->first.c_str());
-            thermo.result = ERR_FAILED_TO_FIND_DEVICE;
+/**
+ * Send command to all DS18* for temperature conversion. Blocks until
+ * conversion completes unless setAsyncConversion(), in which case wait
+ * getConversionMs() before readTemps().
+ */
+void RackTempController::requestTemps(RackState_t& rs) {
+
+    if (_tempReadMode == READ_ALARMED) {
+        // enumerate once only, begin() searches the whole bus
+        if (!_tempSensorsFound) {
+            _tempSensors.begin();
+            _tempSensorsFound = true;
         }
     }
-    
-    // Send command to all DS18* for temperature conversion
+    else {
+        // Initialise sensors each read incase new sensors are added/removed.
+        _tempSensors.begin();
+
+        // useful for new thermo's to get deviceAddress
+        //  searchAndPrintAddresses();
+
+        // Iterate through all devices ensuring they are still connected
+        for (uint8_t i = 0; i < rs.thermoCount; i++) {
+            Temperature_t& thermo = rs.thermos[i];
+            thermo.result = RES_OK;
+            if (!_tempSensors.isConnected(thermo.addr)) {
+                Log.notice(F("Unable to find thermometer %S"), FNAME(thermo.name));
+                thermo.result = ERR_FAILED_TO_FIND_DEVICE;
+            }
+        }
+    }
+
     Log.notice(F("Requesting temperatures"));
     _tempSensors.requestTemperatures();
+}
 
-    // Get temperature for each thermometer
-    for (auto it = thermos.begin(); it != thermos.end(); it++) {
-        Temperature_t& thermo = it->second;
+/**
+ * Read the conversion started by requestTemps().
+ */
+void RackTempController::readTemps(RackState_t& rs) {
+
+    if (_tempReadMode == READ_ALARMED)
+        readAlarmedTempStates(rs);
+    else
+        readTempStates(rs);
+    rs.faultSeq = _faultSeq;
+}
+
+uint16_t RackTempController::getConversionMs() {
+    return _tempSensors.millisToWaitForConversion(_tempSensors.getResolution());
+}
+
+void RackTempController::readTempStates(RackState_t& rs) {
+
+    // Get temperature for each thermometer, sharing one retry budget per cycle
+    uint8_t retries = _tempReadRetries;
+    for (uint8_t i = 0; i < rs.thermoCount; i++) {
+        Temperature_t& thermo = rs.thermos[i];
         // if device found, then read temp
-        if (thermo.result != ERR_FAILED_TO_FIND_DEVICE) {
-            if ((thermo.tempCelsuis = _tempSensors.getTempC(thermo.addr)) == DEVICE_DISCONNECTED_C) {
-                thermo.result = ERR_FAILED_TO_READ_TEMP;
-                Log.warning(F("Failed to read %s temperature"), it->first.c_str());
-            }
-            else {
-                Log.notice(F("%s.tempCelsuis - %F"), it->first.c_str(), thermo.tempCelsuis);
+        if (thermo.result != ERR_FAILED_TO_FIND_DEVICE)
+            readThermo(thermo, retries);
+        if (faultUpdate(thermo.fault, thermo.result, _thermoFault))
+            reportFault(thermo.name, thermo.fault);
+    }
+}
+
+/**
+ * After one broadcast conversion, alarm search finds the thermos whose
+ * reading left the TH/TL band set at their last read. Only those, any
+ * not yet read, and a rotating subset have their scratchpad read, so bus
+ * traffic stays near constant as thermos are added.
+ */
+void RackTempController::readAlarmedTempStates(RackState_t& rs) {
+
+    for (uint8_t i = 0; i < rs.thermoCount; i++)
+        rs.thermos[i].alarm = false;
+
+    // flag thermos answering the alarm search
+    DeviceAddress addr;
+    _tempSensors.resetAlarmSearch();
+    while (_tempSensors.alarmSearch(addr)) {
+        for (uint8_t i = 0; i < rs.thermoCount; i++) {
+            if (memcmp(addr, rs.thermos[i].addr, sizeof(DeviceAddress)) == 0) {
+                rs.thermos[i].alarm = true;
+                break;
             }
         }
     }
+
+    uint8_t n = rs.thermoCount;
+    uint8_t retries = _tempReadRetries;
+    for (uint8_t i = 0; i < n; i++) {
+        Temperature_t& thermo = rs.thermos[i];
+        bool rotate = ((i + n - _rotateNext) % n) < _rotateCount;
+        if (thermo.alarm || rotate || thermo.samples == 0 || thermo.result != RES_OK) {
+            readThermo(thermo, retries);
+            if (faultUpdate(thermo.fault, thermo.result, _thermoFault))
+                reportFault(thermo.name, thermo.fault);
+        }
+    }
+    if (n > 0)
+        _rotateNext = (_rotateNext + _rotateCount) % n;
+}
+
+/**
+ * Read, filter and (in READ_ALARMED mode) re-arm a single thermo.
+ */
+void RackTempController::readThermo(Temperature_t& thermo, uint8_t& retries) {
+
+    ScratchPad sp;
+    int16_t raw;
+    thermo.result = readRawTemp(thermo, raw, retries, sp);
+    if (thermo.result != RES_OK) {
+        // keep last good temperature
+        Log.notice(F("Failed to read %S temperature"), FNAME(thermo.name));
+        return;
+    }
+
+    if (!filterRawTemp(thermo, raw)) {
+        if (thermo.samples == 0) {
+            thermo.result = ERR_FAILED_TO_READ_TEMP;
+            Log.notice(F("%S has not completed a conversion"), FNAME(thermo.name));
+            return;
+        }
+        Log.warning(F("%S sample rejected as outlier, using median"), FNAME(thermo.name));
+    }
+    thermo.tempRaw = raw;
+    char buf[8];
+    Log.notice(F("%S.temp - %s"), FNAME(thermo.name), formatTempRaw(raw, buf));
+
+    if (_tempReadMode == READ_ALARMED)
+        armAlarm(thermo, sp, raw);
+}
+
+/**
+ * Set TH/TL to the control band holding the last reading, so a thermo
+ * alarms as it crosses into a band where control acts differently. Band
+ * edges are the fan curve breakpoints and the setpoint; past the outer
+ * edges TH or TL sit _alarmBandC from the reading. Within a band the
+ * rotating subset keeps readings fresh. Only the scratchpad is written -
+ * no COPY SCRATCHPAD - so re-arming does not wear the EEPROM. Alarm
+ * comparison uses the integer part of the reading only, alarming at
+ * T >= TH or T <= TL.
+ */
+void RackTempController::armAlarm(const Temperature_t& thermo, const ScratchPad& sp, const int16_t raw) {
+
+    int8_t c  = raw >> 4;   // floor
+    int8_t th = c + _alarmBandC;
+    int8_t tl = c - _alarmBandC;
+    bool above = false, below = false;
+
+    const uint8_t n = sizeof(RACK_CURVE)/sizeof(RACK_CURVE[0]);
+    for (uint8_t i = 0; i <= n; i++) {
+        int8_t e = ((i < n) ? RACK_CURVE[i].tempRaw : _setpoint) >> 4;
+        if (e > c && (!above || e < th)) {
+            th = e;
+            above = true;
+        }
+        if (e <= c && (!below || e - 1 > tl)) {
+            tl = e - 1;
+            below = true;
+        }
+    }
+
+    if ((int8_t)sp[2] == th && (int8_t)sp[3] == tl)
+        return;
+
+    _oneWire.reset();
+    _oneWire.select(thermo.addr);
+    _oneWire.write(0x4E);   // WRITE SCRATCHPAD: TH, TL, config
+    _oneWire.write((uint8_t)th);
+    _oneWire.write((uint8_t)tl);
+    _oneWire.write(sp[4]);
+    _oneWire.reset();
+}
+
+/**
+ * Read raw temperature (1/16 C) from the DS18B20 scratchpad, verifying
+ * the CRC. Failed reads are retried while the shared per-cycle budget
+ * lasts.
+ */
+RESULT RackTempController::readRawTemp(Temperature_t& thermo, int16_t& raw, uint8_t& retries, ScratchPad& sp) {
+
+    for (;;) {
+        if (!_tempSensors.readScratchPad(thermo.addr, sp)) {
+            // no presence pulse - not worth retrying
+            return ERR_FAILED_TO_READ_TEMP;
+        }
+
+        // all zeros passes CRC but indicates a shorted bus
+        bool zeros = true;
+        for (uint8_t i = 0; i < sizeof(ScratchPad) && zeros; i++)
+            zeros = (sp[i] == 0);
+
+        if (!zeros && OneWire::crc8(sp, 8) == sp[8]) {
+            raw = ((int16_t)sp[1] << 8) | sp[0];
+            return RES_OK;
+        }
+
+        thermo.counters.crcErrors++;
+        if (retries == 0)
+            return ERR_TEMP_CRC;
+
+        retries--;
+        thermo.counters.retries++;
+    }
+}
+
+/**
+ * Hampel filter over the last TEMP_FILTER_DEPTH samples. A sample further
+ * from the window median than 4.5 MAD (approx 3 sigma), or _tempOutlierFloor,
+ * is replaced by the median. The 85C power-on value is rejected unless the
+ * rack really is that hot. Returns false if the sample was rejected.
+ */
+bool RackTempController::filterRawTemp(Temperature_t& thermo, int16_t& raw) const {
+
+    const int16_t POWER_ON_RAW = 85*16;
+
+    bool accept = true;
+    int16_t median = raw;
+    if (thermo.samples > 0) {
+        median = medianRaw(thermo.window, thermo.samples);
+
+        int16_t dev[TEMP_FILTER_DEPTH];
+        for (uint8_t i = 0; i < thermo.samples; i++)
+            dev[i] = abs(thermo.window[i] - median);
+        int16_t limit = (medianRaw(dev, thermo.samples) * 9) / 2;
+        if (limit < _tempOutlierFloor)
+            limit = _tempOutlierFloor;
+
+        if (thermo.samples >= 3 && abs(raw - median) > limit)
+            accept = false;
+        if (raw == POWER_ON_RAW && abs(median - POWER_ON_RAW) > 16)
+            accept = false;
+    }
+    else if (raw == POWER_ON_RAW) {
+        // no history to judge against, leave the window empty
+        thermo.counters.rejected++;
+        return false;
+    }
+
+    // window always takes the sample so a genuine step change
+    // becomes the median after a couple of cycles
+    thermo.window[thermo.next] = raw;
+    thermo.next = (thermo.next + 1) % TEMP_FILTER_DEPTH;
+    if (thermo.samples < TEMP_FILTER_DEPTH)
+        thermo.samples++;
+
+    if (!accept) {
+        thermo.counters.rejected++;
+        raw = median;
+    }
+    return accept;
+}
+
+/**
+ * Median of up to TEMP_FILTER_DEPTH samples by insertion sort.
+ */
+int16_t RackTempController::medianRaw(const int16_t* samples, const uint8_t n) const {
+
+    int16_t sorted[TEMP_FILTER_DEPTH];
+    for (uint8_t i = 0; i < n; i++) {
+        int16_t v = samples[i];
+        uint8_t j = i;
+        for (; j > 0 && sorted[j-1] > v; j--)
+            sorted[j] = sorted[j-1];
+        sorted[j] = v;
+    }
+    return sorted[n/2];
 }
 
 /**
@@ -232,86 +1463,84 @@ void RackTempController::printAddress(const DeviceAddress deviceAddress) const
 RackState_t RackTempController::build() const {
 
     RackState_t rs;
-    
-    rs.thermos.insert({ 
-        "topRack", {
-            { 0x28, 0xAA, 0x48, 0x66, 0x53, 0x14, 0x01, 0xD5 },
-            0.0,
-            RES_OK
-        }
-    });
-
-    rs.thermos.insert({ 
-        "baseRack", {
-            { 0x28, 0xAA, 0x51, 0x59, 0x53, 0x14, 0x01, 0x88 },
-            0.0,
-            RES_OK
-        }
-    });
-
-    rs.aveTempCelsius = 0.0;
-
-    rs.fans.insert({
-        1, {
-            "TL",
-            0, 0,
-            400, 1200,
-            RES_OK
-        }
-    });
+    memset(&rs, 0, sizeof(rs));
 
-    rs.fans.insert({
-        2, {
-            "TR",
-            0, 0,
-            400, 1200,
-            RES_OK
-        }
-    });
+    for (uint8_t i = 0; i < THERMO_COUNT; i++) {
+        Temperature_t& thermo = rs.thermos[i];
+        thermo.name = THERMO_SPECS[i].name;
+        memcpy_P(thermo.addr, THERMO_SPECS[i].addr, sizeof(DeviceAddress));
+        thermo.result = RES_OK;
+    }
+    rs.thermoCount = THERMO_COUNT;
 
-    rs.fans.insert({
-        3, {
-            "BL",
-            0, 0,
-            400, 1200,
-            RES_OK
-        }
-    });
+    for (uint8_t i = 0; i < FAN_COUNT; i++) {
+        FanSpec_t spec;
+        memcpy_P(&spec, &FAN_SPECS[i], sizeof(spec));
+        FanState_t& fan = rs.fans[i];
+        fan.position = FAN_SPECS[i].position;
+        fan.minRpm   = spec.minRpm;
+        fan.maxRpm   = spec.maxRpm;
+        fan.result   = RES_OK;
+        fan.minDuty  = spec.minDuty;
+        fan.maxDuty  = spec.maxDuty;
+        fan.idleMw   = spec.idleMw;
+        fan.maxMw    = spec.maxMw;
+    }
+    rs.fanCount = FAN_COUNT;
 
-    rs.fans.insert({
-        4, {
-            "BR",
-            0, 0,
-            400, 1200,
-            RES_OK
-        }
-    });
+    for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+        ZoneSpec_t spec;
+        memcpy_P(&spec, &ZONE_SPECS[z], sizeof(spec));
+        Zone_t& zone = rs.zones[z];
+        zone.name = ZONE_SPECS[z].name;
+        memcpy(zone.thermos, spec.thermos, sizeof(zone.thermos));
+        memcpy(zone.weights, spec.weights, sizeof(zone.weights));
+        zone.thermoCount = spec.thermoCount;
+        memcpy(zone.fans, spec.fans, sizeof(zone.fans));
+        zone.fanCount = spec.fanCount;
+        zone.aggregate = spec.aggregate;
+        zone.result = RES_OK;
+    }
+    rs.zoneCount = ZONE_COUNT;
 
     return rs;
 }
 
-RackState_t RackTempController::build_debug() const {
-    
-    RackState_t rs;
-    
-    rs.thermos.insert({ 
-        "topRack", {
-            { 0x28, 0xFF, 0xBF, 0xDC, 0x51, 0x17, 0x04, 0x48 }, //keyes
-            0.0,
-            RES_OK
-        }
-    });
+void RackTempController::buildView(const RackState_t& rs, RackView_t& view) {
 
-    rs.aveTempCelsius = 0.0;
-    
-    rs.fans.insert({
-        1,{
-            "TL",
-            0, 0,
-            400, 1200,
-            RES_OK
-        }
-    });
+    uint8_t i;
+    for (i = 0; i < rs.thermoCount; i++) {
+        const Temperature_t& thermo = rs.thermos[i];
+        ThermoView_t& tv = view.thermos[i];
+        tv.name    = thermo.name;
+        tv.tempRaw = thermo.tempRaw;
+        tv.trend   = thermo.trend;
+        tv.fault   = thermo.fault;
+    }
+    view.thermoCount = rs.thermoCount;
+    view.aveTempRaw  = rs.aveTempRaw;
 
-    return rs;
-}
\ No newline at end of file
+    view.fanCount = rs.fanCount;
+    for (i = 0; i < view.fanCount; i++) {
+        const FanState_t& fan = rs.fans[i];
+        FanView_t& fv = view.fans[i];
+        fv.position = fan.position;
+        fv.rpm      = fan.rpm;
+        fv.minRpm   = fan.minRpm;
+        fv.maxRpm   = fan.maxRpm;
+        fv.health   = fan.health;
+        fv.drift    = fan.drift;
+        fv.jitter   = fan.jitter;
+        fv.fault    = fan.fault;
+    }
+
+    for (i = 0; i < rs.zoneCount; i++)
+        view.zoneTrends[i] = rs.zones[i].trend;
+    view.zoneCount = rs.zoneCount;
+
+    view.degraded  = rs.degraded;
+    view.powerUtil = rs.powerUtil;
+    view.stats     = rs.stats;
+    view.healthSeq = rs.healthSeq;
+    view.faultSeq  = rs.faultSeq;
+}
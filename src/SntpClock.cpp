@@ -0,0 +1,86 @@
+#include "SntpClock.h"
+#include <ArduinoLog.h>
+
+#define NTP_PORT        123
+#define NTP_LOCAL_PORT  8888
+#define NTP_PACKET_SIZE 48
+#define NTP_UNIX_OFFSET 2208988800UL    // 1900 to 1970
+
+/**
+ * Send a client request and wait for the transmit timestamp. Replies
+ * are only accepted from port 123, in server mode, not kiss-of-death
+ * (stratum 0), with a non-zero time, and echoing our transmit timestamp
+ * as their originate timestamp, so a stray packet can't set the clock.
+ */
+RESULT SntpClock::sync() {
+
+    uint8_t buf[NTP_PACKET_SIZE];
+    memset(buf, 0, sizeof(buf));
+    buf[0] = 0x1B;  // LI 0, version 3, mode 3 (client)
+
+    // transmit timestamp as a nonce, the server echoes it back
+    uint32_t nonce = micros();
+    memcpy(&buf[44], &nonce, sizeof(nonce));
+
+    _attemptMs = millis();
+    _udp.begin(NTP_LOCAL_PORT);
+    _udp.beginPacket(_server, NTP_PORT);
+    _udp.write(buf, sizeof(buf));
+    _udp.endPacket();
+
+    RESULT res = ERR_NTP_NO_RESPONSE;
+    uint32_t secs = 0;
+    unsigned long t1 = millis();
+    while ((millis() - t1) <= _timeoutMs) {
+        if (_udp.parsePacket() < NTP_PACKET_SIZE)
+            continue;
+        bool fromServer = _udp.remotePort() == NTP_PORT;
+        _udp.read(buf, sizeof(buf));
+
+        // transmit timestamp seconds, big endian
+        secs = ((uint32_t)buf[40] << 24) | ((uint32_t)buf[41] << 16) |
+               ((uint32_t)buf[42] << 8)  | buf[43];
+
+        if (fromServer && (buf[0] & 0x07) == 4 && buf[1] != 0 &&
+            secs > NTP_UNIX_OFFSET && memcmp(&buf[28], &nonce, sizeof(nonce)) == 0) {
+            res = RES_OK;
+            break;
+        }
+        res = ERR_NTP_BAD_REPLY;    // keep waiting for the real reply
+    }
+    _udp.stop();
+
+    if (res != RES_OK) {
+        if (res == ERR_NTP_BAD_REPLY)
+            Log.warning(F("Bad reply from NTP server %s"), _server);
+        else
+            Log.warning(F("No response from NTP server %s"), _server);
+        return res;
+    }
+
+    // update as one, now() is read from other tasks
+    noInterrupts();
+    _epoch  = secs - NTP_UNIX_OFFSET;
+    _syncMs = millis();
+    _synced = true;
+    interrupts();
+    Log.notice(F("NTP time - %l"), _epoch);
+    return RES_OK;
+}
+
+void SntpClock::maintain() {
+    unsigned long period = _synced ? _resyncMs : _retryMs;
+    if ((millis() - _attemptMs) >= period)
+        sync();
+}
+
+uint32_t SntpClock::now() const {
+    return _epoch + (millis() - _syncMs) / 1000;
+}
+
+uint16_t SntpClock::minuteOfDay() const {
+    int32_t m = (int32_t)((now() / 60) % 1440) + _utcOffsetMin;
+    if (m < 0)
+        m += 1440;
+    return m % 1440;
+}
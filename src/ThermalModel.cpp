@@ -0,0 +1,124 @@
+#include "ThermalModel.h"
+
+#define RLS_LAMBDA     0.99     // forgetting factor
+#define RLS_P0         100.0    // initial covariance
+#define RLS_MAX_TRACE  10000.0  // stop forgetting past this, avoids windup
+#define MPC_EFFORT     0.05     // cost per % duty per step, ~ 1C overshoot per 20%
+
+void ThermalModel::reset() {
+    for (uint8_t i = 0; i < THERMAL_MODEL_PARAMS; i++) {
+        _theta[i] = 0;
+        for (uint8_t j = 0; j < THERMAL_MODEL_PARAMS; j++)
+            _P[i][j] = (i == j) ? RLS_P0 : 0;
+    }
+    _primed  = false;
+    _samples = 0;
+}
+
+/**
+ * RLS step on the rate of change since the previous sample, using the
+ * temp and duty that applied over that interval.
+ */
+void ThermalModel::update(const int16_t tempRaw, const uint8_t duty, const unsigned long nowMs) {
+
+    float t = (float)tempRaw / TEMP_RAW_SCALE;
+    float d = duty / 100.0;
+
+    if (_primed) {
+        float dtMin = (nowMs - _prevMs) / 60000.0;
+        // skip implausible intervals, eg after a long blocking call
+        if (dtMin > 0.01 && dtMin < 2.0) {
+            float phi[THERMAL_MODEL_PARAMS] = { 1.0, _prevT, _prevD, _prevD * _prevT };
+            float y = (t - _prevT) / dtMin;
+
+            float Pphi[THERMAL_MODEL_PARAMS];
+            float denom = RLS_LAMBDA;
+            float yhat = 0;
+            for (uint8_t i = 0; i < THERMAL_MODEL_PARAMS; i++) {
+                Pphi[i] = 0;
+                for (uint8_t j = 0; j < THERMAL_MODEL_PARAMS; j++)
+                    Pphi[i] += _P[i][j] * phi[j];
+                denom += phi[i] * Pphi[i];
+                yhat += _theta[i] * phi[i];
+            }
+
+            float err = y - yhat;
+            float trace = 0;
+            for (uint8_t i = 0; i < THERMAL_MODEL_PARAMS; i++)
+                trace += _P[i][i];
+            float lambda = (trace > RLS_MAX_TRACE) ? 1.0 : RLS_LAMBDA;
+
+            // P symmetric so phi'P == (P phi)'
+            for (uint8_t i = 0; i < THERMAL_MODEL_PARAMS; i++) {
+                float k = Pphi[i] / denom;
+                _theta[i] += k * err;
+                for (uint8_t j = 0; j < THERMAL_MODEL_PARAMS; j++)
+                    _P[i][j] = (_P[i][j] - k * Pphi[j]) / lambda;
+            }
+
+            if (_samples < 0xFFFF)
+                _samples++;
+        }
+    }
+
+    _prevT  = t;
+    _prevD  = d;
+    _prevMs = nowMs;
+    _primed = true;
+}
+
+bool ThermalModel::isValid() const {
+    // more fan must mean more cooling above ambient
+    return _samples >= _minSamples && _theta[3] < 0;
+}
+
+float ThermalModel::getAmbient() const {
+    return (_theta[3] != 0) ? -_theta[2] / _theta[3] : 0;
+}
+
+/**
+ * dT/dt, C per min
+ */
+float ThermalModel::predictRate(const float t, const float d) const {
+    return _theta[0] + _theta[1] * t + _theta[2] * d + _theta[3] * d * t;
+}
+
+/**
+ * Simulate each candidate duty held over the horizon, costing squared
+ * overshoot above setpoint plus fan effort, and return the cheapest.
+ * Candidates step by 5 from minDuty and always end on maxDuty, 13 for
+ * a 40..100 clamp, x 5 steps, a few ms on the AVR.
+ */
+uint8_t ThermalModel::chooseDuty(const int16_t tempRaw, const int16_t setpointRaw,
+                                 const uint8_t minDuty, const uint8_t maxDuty) const {
+
+    float t0 = (float)tempRaw / TEMP_RAW_SCALE;
+    float sp = (float)setpointRaw / TEMP_RAW_SCALE;
+
+    uint8_t best = maxDuty;
+    float bestCost = 0;
+    bool first = true;
+
+    for (uint16_t duty = minDuty; ; duty += _dutyStep) {
+        if (duty > maxDuty)
+            duty = maxDuty;
+        float d = duty / 100.0;
+        float t = t0;
+        float cost = 0;
+        for (uint8_t k = 0; k < _horizonSteps; k++) {
+            t += predictRate(t, d);     // one minute step
+            float over = t - sp;
+            if (over > 0)
+                cost += over * over;
+            cost += MPC_EFFORT * duty;
+        }
+        if (first || cost < bestCost) {
+            best = duty;
+            bestCost = cost;
+            first = false;
+        }
+        if (duty >= maxDuty)
+            break;
+    }
+    return best;
+}
@@ -0,0 +1,57 @@
+#include "ThermalProfile.h"
+#include <EEPROM.h>
+#include <ArduinoLog.h>
+
+#define PROFILE_MAGIC   0xA5
+#define PROFILE_VERSION 2       // 2: zones by RackTopology.h order, top then base
+
+void ThermalProfile::begin() {
+    if (EEPROM.read(EEPROM_PROFILE_ADDR) == PROFILE_MAGIC &&
+        EEPROM.read(EEPROM_PROFILE_ADDR + 1) == PROFILE_VERSION)
+        return;
+
+    Log.notice(F("Initialising thermal profile"));
+    for (uint8_t z = 0; z < MAX_PROFILE_ZONES; z++) {
+        for (uint8_t b = 0; b < PROFILE_BUCKETS; b++)
+            EEPROM.update(address(z, b), 0);
+    }
+    EEPROM.update(EEPROM_PROFILE_ADDR, PROFILE_MAGIC);
+    EEPROM.update(EEPROM_PROFILE_ADDR + 1, PROFILE_VERSION);
+}
+
+void ThermalProfile::update(const uint8_t zone, const uint8_t bucket, const int16_t tempRaw) {
+
+    if (zone >= MAX_PROFILE_ZONES || bucket >= PROFILE_BUCKETS)
+        return;
+
+    if (_state[zone] == BUCKET_NONE) {
+        _startRaw[zone] = tempRaw;
+        _bucket[zone]   = bucket;
+        _state[zone]    = BUCKET_PARTIAL;
+        return;
+    }
+    if (bucket == _bucket[zone])
+        return;
+
+    // only learn from a bucket observed end to end. Rolling over to the
+    // next bucket starts it at its boundary, any other jump is a clock
+    // step landing mid-bucket.
+    bool next = bucket == (_bucket[zone] + 1) % PROFILE_BUCKETS;
+    if (next && _state[zone] == BUCKET_FULL) {
+        int16_t rise = constrain(tempRaw - _startRaw[zone], -127, 127);
+        int16_t p = (int8_t)EEPROM.read(address(zone, _bucket[zone]));
+        int16_t delta = rise - p;
+        p += (delta + ((delta > 0) ? 4 : -4)) / 8;
+        EEPROM.update(address(zone, _bucket[zone]), (uint8_t)(int8_t)p);
+    }
+
+    _startRaw[zone] = tempRaw;
+    _bucket[zone]   = bucket;
+    _state[zone]    = next ? BUCKET_FULL : BUCKET_PARTIAL;
+}
+
+int8_t ThermalProfile::expectedRise(const uint8_t zone, const uint8_t bucket) const {
+    if (zone >= MAX_PROFILE_ZONES)
+        return 0;
+    return (int8_t)EEPROM.read(address(zone, bucket % PROFILE_BUCKETS));
+}
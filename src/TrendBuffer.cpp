@@ -0,0 +1,80 @@
+#include "TrendBuffer.h"
+
+void TrendBuffer::push(const TrendSample_t& sample) {
+
+    // drop the oldest, at x = -(TREND_DEPTH-1)
+    if (_count == TREND_DEPTH) {
+        const TrendSample_t& old = _ring[_head];
+        int16_t x = -(TREND_DEPTH-1);
+        for (uint8_t ch = 0; ch <= TREND_ZONES; ch++) {
+            if (!(old.valid & TREND_VALID(ch)))
+                continue;
+            Sums_t& s = _sums[ch];
+            int16_t y = value(old, ch);
+            s.sy  -= y;
+            s.sxy -= (int32_t)x * y;
+            s.sx  -= x;
+            s.sxx -= x * x;
+            s.n--;
+        }
+        for (uint8_t i = 0; i < FAN_COUNT; i++) {
+            _dutySum[i] -= old.duty[i];
+            _rpmSum[i]  -= old.rpm[i];
+        }
+        _count--;
+    }
+
+    // age the rest by one, then add the newest at x = 0
+    for (uint8_t ch = 0; ch <= TREND_ZONES; ch++) {
+        Sums_t& s = _sums[ch];
+        s.sxy -= s.sy;
+        s.sxx -= 2 * s.sx - s.n;
+        s.sx  -= s.n;
+        if (sample.valid & TREND_VALID(ch)) {
+            s.sy += value(sample, ch);
+            s.n++;
+        }
+    }
+    for (uint8_t i = 0; i < FAN_COUNT; i++) {
+        _dutySum[i] += sample.duty[i];
+        _rpmSum[i]  += sample.rpm[i];
+    }
+
+    _ring[_head] = sample;
+    _head = (_head + 1) % TREND_DEPTH;
+    _count++;
+}
+
+bool TrendBuffer::mean(const uint8_t ch, int16_t& raw) const {
+    if (ch > TREND_ZONES || _sums[ch].n == 0)
+        return false;
+
+    const Sums_t& s = _sums[ch];
+    int32_t half = (s.sy < 0) ? -(int32_t)s.n/2 : (int32_t)s.n/2;
+    raw = (s.sy + half) / s.n;
+    return true;
+}
+
+int16_t TrendBuffer::rise(const uint8_t ch) const {
+    if (ch > TREND_ZONES || _sums[ch].n < 2)
+        return 0;
+
+    const Sums_t& s = _sums[ch];
+    int32_t den = (int32_t)s.n * s.sxx - (int32_t)s.sx * s.sx;
+    if (den == 0)
+        return 0;
+    int32_t num = (int32_t)s.n * s.sxy - (int32_t)s.sx * s.sy;
+    return (num * (TREND_DEPTH-1)) / den;
+}
+
+uint8_t TrendBuffer::meanDuty(const uint8_t fanid) const {
+    if (fanid < 1 || fanid > FAN_COUNT || _count == 0)
+        return 0;
+    return (_dutySum[fanid-1] + _count/2) / _count;
+}
+
+uint16_t TrendBuffer::meanRpm(const uint8_t fanid) const {
+    if (fanid < 1 || fanid > FAN_COUNT || _count == 0)
+        return 0;
+    return (_rpmSum[fanid-1] + _count/2) / _count;
+}
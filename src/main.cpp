@@ -1,11 +1,16 @@
 #ifndef UNIT_TEST
 
+#include <Arduino_FreeRTOS.h>
+#include <semphr.h>
+#include <queue.h>
 #include <ArduinoLog.h>
 #include "RackTempController.h"
 #include "OLEDDisplay.h"
 #include "MqttManager.h"
 //#include "MAX31790FanControl.h"
 #include "ArduinoFanControl.h"
+#include "SntpClock.h"
+#include "LogRing.h"
 
 void onMqttMessage(int messageSize);
 
@@ -34,20 +39,81 @@ const char* CLIENT_ID      = "RackTempController.Arduino.Client";
 const char* MQTT_SERVER_IP = "k8smqtt"; //"192.168.2.11";
 const uint16_t MQTT_PORT   = 1883;
 
+// NTP config
+const char* NTP_SERVER     = "pool.ntp.org";
+const int16_t UTC_OFFSET_MIN = 600;     // AEST
+
 // Setup a oneWire instance to communicate with any OneWire device
 OneWire oneWire(PIN_ONE_WIRE_BUS);
 
 //MAX31790           fanControl(0xC0, 4);
-ArduinoFanControl  fanControl(4);
+ArduinoFanControl  fanControl(FAN_COUNT, true);    // staggered PWM phases
 RackTempController rtc(oneWire, fanControl);
 //OLEDDisplay        oled(PIN_CS, PIN_DC, PIN_RESET, PIN_IR);
 OLEDDisplay        oled(PIN_CS, PIN_DC, PIN_RESET);
 EthernetClient     ethClient;
 MqttClient         mqttClient(ethClient);
 MqttManager        mqttManager(&mqttClient, CLIENT_ID, MQTT_SERVER_IP, MQTT_PORT);
+SntpClock          sntp(NTP_SERVER, UTC_OFFSET_MIN);
+
+RackState_t        rs;        // persists across cycles for filtering and trends
+RackView_t         view;      // of rs, for the display and network tasks
+NetworkState_t     ns;
+LogRing            logRing;
 
 bool ethernetPresent = false;
 bool displayOnNotOff = true;
+bool historyRequested = false;   // export on next network run, not from the mqtt callback
+uint16_t logDropped = 0;         // log lines dropped, last reported
+
+/**
+ * Tasks, highest priority first. Control runs on events from the temp
+ * and tach tasks, and every period for stall checks. Network also
+ * forwards the log as warning and error lines are written. The others
+ * run once per period. Stack is in bytes, AVR stack entries are bytes.
+ */
+void controlTask(void* param);
+void tempTask(void* param);
+void tachTask(void* param);
+void displayTask(void* param);
+void networkTask(void* param);
+
+typedef struct {
+    const char*    name;
+    TaskFunction_t run;
+    uint16_t       periodMs;
+    UBaseType_t    priority;
+    uint16_t       stack;
+    TaskHandle_t   handle;
+} RackTask_t;
+
+RackTask_t tasks[] = {
+    { "control", controlTask,   30, 4, 640, NULL },
+    { "temp",    tempTask,    2000, 3, 320, NULL },
+    { "tach",    tachTask,    1000, 2, 256, NULL },
+    { "display", displayTask, 2000, 1, 384, NULL },
+    { "network", networkTask, 5000, 1, 640, NULL }
+};
+#define TASK_COUNT (sizeof(tasks) / sizeof(tasks[0]))
+#define TASK_CONTROL 0
+#define TASK_NETWORK 4
+
+// control task events
+#define EVENT_TEMPS 0x01    // readTemps() done
+#define EVENT_TACH  0x02    // sample waiting in tachQueue
+
+// network task events
+#define EVENT_LOG   0x01    // log line completed
+
+const unsigned long STACK_REPORT_MS = 600000;
+const uint16_t      STACK_LOW_BYTES = 48;
+
+SemaphoreHandle_t stateLock;     // rs and controller state
+SemaphoreHandle_t viewLock;      // view
+SemaphoreHandle_t spiLock;       // OLED and ethernet share SPI, and are the only heap users
+SemaphoreHandle_t logLock;       // one log line at a time
+QueueHandle_t     tachQueue;     // latest TachSample_t, overwritten
+QueueHandle_t     anomalyQueue;  // AnomalyEvent_t, control to network
 
 RESULT ethernetSetup() {
     RESULT res = RES_OK;
@@ -76,28 +142,47 @@ RESULT ethernetSetup() {
     return res;
 }
 
-// log support
+// log support, the lock is held from prefix to suffix
 void printTimestamp(Print* logOutput) {
+    xSemaphoreTake(logLock, portMAX_DELAY);
     char c[12];
     sprintf(c, "%10lu ", millis());
     logOutput->print(c);
 }
 
+// only warnings and errors are logged, forward each as it completes
 void printNewline(Print* logOutput) {
     logOutput->print('\n');
+    xSemaphoreGive(logLock);
+    if (tasks[TASK_NETWORK].handle != NULL)
+        xTaskNotify(tasks[TASK_NETWORK].handle, EVENT_LOG, eSetBits);
 }
 
 void setup(void)
 {
     Serial.begin(9600);
 
-    // setup logging
-    Log.begin(LOG_LEVEL_WARNING, &mqttManager); // use &Serial only to avoid MQTT events
-//    Log.begin(LOG_LEVEL_VERBOSE, &mqttManager);   // use &Serial only to avoid log output being published as events
+    stateLock    = xSemaphoreCreateMutex();
+    viewLock     = xSemaphoreCreateMutex();
+    spiLock      = xSemaphoreCreateMutex();
+    logLock      = xSemaphoreCreateMutex();
+    tachQueue    = xQueueCreate(1, sizeof(TachSample_t));
+    anomalyQueue = xQueueCreate(MAX_ANOMALY_EVENTS, sizeof(AnomalyEvent_t));
+
+    // setup logging, buffered for the network task to forward to mqtt
+    Log.begin(LOG_LEVEL_WARNING, &logRing);
+//    Log.begin(LOG_LEVEL_VERBOSE, &logRing);
     Log.setPrefix(printTimestamp);
     Log.setSuffix(printNewline);
 
     fanControl.initialise();
+    rs = rtc.build();
+    RackTempController::buildView(rs, view);
+    rtc.initialise();
+    rtc.setParking(true);
+    rtc.setRpmTrim(true);
+    rtc.setAsyncConversion(true);   // temp task sleeps through conversion
+    // rtc.setTempReadMode(READ_ALARMED);   // for buses with many thermos
 
     oled.initialise();
 
@@ -105,6 +190,10 @@ void setup(void)
     if (res == RES_OK) {
         oled.render("Ethernet initialised");
         Log.notice(F("Ethernet initialised"));
+
+        if (sntp.sync() == RES_OK)
+            oled.render("NTP synced");
+        rtc.setClock(&sntp);
         
         if (mqttManager.initialise()==0) {
             oled.render("Mqtt initialised");
@@ -119,51 +208,274 @@ void setup(void)
         oled.render("Ethernet failed to initialised");
         Log.error(F("Ethernet failed to initalise %d"), res);
     }
+
+    // scheduler starts once setup() returns
+    for (uint8_t i = 0; i < TASK_COUNT; i++) {
+        RackTask_t& t = tasks[i];
+        if (xTaskCreate(t.run, t.name, t.stack, &t, t.priority, &t.handle) != pdPASS)
+            Log.error(F("Failed to create task %s"), t.name);
+    }
 }
-  
+
+/**
+ * Runs as the idle task, all work is in the tasks above.
+ */
 void loop(void) {
+}
 
-    NetworkState_t ns;
-    RackState_t rs = rtc.build();
-    
-    if (ethernetPresent) {
-        ns.ethernetIP = Ethernet.localIP();
-        ns.mqttServerIP = MQTT_SERVER_IP;
-        ns.mqttPort = MQTT_PORT;
+/**
+ * Moves new anomalies to the network task and refreshes the view,
+ * skipped if a reader holds it. Called holding stateLock.
+ */
+void handoff() {
+
+    for (uint8_t i = 0; i < rs.anomalyCount; i++) {
+        if (xQueueSend(anomalyQueue, &rs.anomalies[i], 0) != pdTRUE)
+            Log.warning(F("Anomaly queue full"));
+    }
+    rs.anomalyCount = 0;
 
-        mqttManager.poll();
+    if (xSemaphoreTake(viewLock, 0) == pdTRUE) {
+        RackTempController::buildView(rs, view);
+        xSemaphoreGive(viewLock);
     }
+}
+
+/**
+ * Stall checks every period, fan duties and trends on new temps and
+ * tach readings on new samples.
+ */
+void controlTask(void* param) {
+
+    const RackTask_t* task = (const RackTask_t*)param;
+    TachSample_t sample;
+
+    for (;;) {
+        uint32_t events = 0;
+        xTaskNotifyWait(0, EVENT_TEMPS | EVENT_TACH, &events, pdMS_TO_TICKS(task->periodMs));
+
+        xSemaphoreTake(stateLock, portMAX_DELAY);
+        rtc.checkStalls(rs);
+        rtc.reportStalls(rs);
+        if (events & EVENT_TEMPS)
+            rtc.updateFans(rs);
+        if ((events & EVENT_TACH) && xQueueReceive(tachQueue, &sample, 0) == pdTRUE)
+            rtc.updateTach(rs, sample);
+        if (events & EVENT_TEMPS)
+            rtc.updateTrends(rs);
+        if (events)
+            handoff();
+        xSemaphoreGive(stateLock);
+    }
+}
+
+/**
+ * Starts a conversion and sleeps through it, rather than blocking.
+ */
+void tempTask(void* param) {
 
-    // read temperatures, modify fan speed
-    rtc.process(rs);
+    const RackTask_t* task = (const RackTask_t*)param;
+    TickType_t wake = xTaskGetTickCount();
 
-    // render rack state, network state
-    if (displayOnNotOff)
-        oled.render(rs, ns);
+    for (;;) {
+        xSemaphoreTake(stateLock, portMAX_DELAY);
+        rtc.requestTemps(rs);
+        uint16_t conversionMs = rtc.getConversionMs();
+        xSemaphoreGive(stateLock);
 
-    if (ethernetPresent) {
-        // emit rackstate data, will reconnect if required
-        mqttManager.publish(rs);
+        vTaskDelay(pdMS_TO_TICKS(conversionMs) + 1);
 
-        // maintain IP via DHCP
-        int res = Ethernet.maintain();
-        if (res!=0)
-            Log.notice(F("Ethernet maintain - %d"), res);
-    }    
+        xSemaphoreTake(stateLock, portMAX_DELAY);
+        rtc.readTemps(rs);
+        xSemaphoreGive(stateLock);
+        xTaskNotify(tasks[TASK_CONTROL].handle, EVENT_TEMPS, eSetBits);
+
+        vTaskDelayUntil(&wake, pdMS_TO_TICKS(task->periodMs));
+    }
 }
 
+/**
+ * Counts tach edges without holding the rack state, sleeping through
+ * the window.
+ */
+void tachTask(void* param) {
+
+    const RackTask_t* task = (const RackTask_t*)param;
+    TickType_t wake = xTaskGetTickCount();
+    TachSample_t sample;
+
+    for (;;) {
+        rtc.startTach();
+        vTaskDelay(pdMS_TO_TICKS(rtc.getTachWindowMs()));
+        rtc.sampleTach(sample);
+        xQueueOverwrite(tachQueue, &sample);
+        xTaskNotify(tasks[TASK_CONTROL].handle, EVENT_TACH, eSetBits);
+
+        vTaskDelayUntil(&wake, pdMS_TO_TICKS(task->periodMs));
+    }
+}
+
+void displayTask(void* param) {
+
+    const RackTask_t* task = (const RackTask_t*)param;
+    TickType_t wake = xTaskGetTickCount();
+
+    for (;;) {
+        xSemaphoreTake(spiLock, portMAX_DELAY);
+        if (displayOnNotOff) {
+            // render rack state, network state
+            xSemaphoreTake(viewLock, portMAX_DELAY);
+            oled.render(view, ns);
+            xSemaphoreGive(viewLock);
+        }
+        xSemaphoreGive(spiLock);
+
+        vTaskDelayUntil(&wake, pdMS_TO_TICKS(task->periodMs));
+    }
+}
+
+/**
+ * Least free stack of each task, published and warned on when low.
+ */
+void reportStacks() {
+
+    for (uint8_t i = 0; i < TASK_COUNT; i++) {
+        const RackTask_t& t = tasks[i];
+        if (t.handle == NULL)
+            continue;
+        uint16_t freeBytes = uxTaskGetStackHighWaterMark(t.handle);
+        if (freeBytes < STACK_LOW_BYTES)
+            Log.warning(F("Task %s stack low, %d bytes free"), t.name, freeBytes);
+        if (ethernetPresent)
+            mqttManager.publishStack(t.name, freeBytes);
+    }
+}
+
+/**
+ * Forwards completed log lines, to serial and mqtt once connected.
+ * Called holding spiLock.
+ */
+void drainLog() {
+
+    logRing.drain(mqttManager);
+
+    xSemaphoreTake(logLock, portMAX_DELAY);
+    uint16_t dropped = logRing.getDropped();
+    xSemaphoreGive(logLock);
+    if (dropped != logDropped) {
+        Log.warning(F("Log ring full, %d lines dropped"), dropped - logDropped);
+        logDropped = dropped;
+    }
+}
+
+/**
+ * Publishes every period, and drains the log between periods as lines
+ * are written.
+ */
+void networkTask(void* param) {
+
+    const RackTask_t* task = (const RackTask_t*)param;
+    const TickType_t period = pdMS_TO_TICKS(task->periodMs);
+    TickType_t last = xTaskGetTickCount() - period;
+    unsigned long stackReportMs = millis() - STACK_REPORT_MS;
+    AnomalyEvent_t event;
+
+    for (;;) {
+        TickType_t elapsed = xTaskGetTickCount() - last;
+        if (elapsed < period) {
+            xTaskNotifyWait(0, EVENT_LOG, NULL, period - elapsed);
+            if ((TickType_t)(xTaskGetTickCount() - last) < period) {
+                xSemaphoreTake(spiLock, portMAX_DELAY);
+                drainLog();
+                xSemaphoreGive(spiLock);
+                continue;
+            }
+        }
+        last += period;
+
+        xSemaphoreTake(spiLock, portMAX_DELAY);
+
+        if (ethernetPresent) {
+            ns.ethernetIP = Ethernet.localIP();
+            ns.mqttServerIP = MQTT_SERVER_IP;
+            ns.mqttPort = MQTT_PORT;
+
+            mqttManager.poll();
+            sntp.maintain();
+
+            // emit rackstate data, will reconnect if required
+            xSemaphoreTake(viewLock, portMAX_DELAY);
+            mqttManager.publish(view);
+            if (historyRequested) {
+                xSemaphoreTake(stateLock, portMAX_DELAY);
+                rtc.setHistoryPaused(true);
+                xSemaphoreGive(stateLock);
+
+                mqttManager.publishHistory(rtc.getHistory(), view);
+                rtc.setHistoryPaused(false);
+                historyRequested = false;
+            }
+            xSemaphoreGive(viewLock);
+
+            while (xQueueReceive(anomalyQueue, &event, 0) == pdTRUE)
+                mqttManager.publishAnomaly(event);
+        }
+
+        if ((millis() - stackReportMs) >= STACK_REPORT_MS) {
+            stackReportMs = millis();
+            reportStacks();
+        }
+
+        drainLog();
+
+        if (ethernetPresent) {
+            // maintain IP via DHCP
+            int res = Ethernet.maintain();
+            if (res!=0)
+                Log.notice(F("Ethernet maintain - %d"), res);
+        }
+
+        xSemaphoreGive(spiLock);
+    }
+}
+
+/**
+ * Called from mqttManager.poll(), in the network task.
+ */
 void onMqttMessage(int messageSize) {
     
     Serial.println("rx");
+    String topic = mqttClient.messageTopic();
     char buf[128];
     int i=0;
     while(mqttClient.available()) {
-        if (i<128) 
-            buf[i++] = mqttClient.read();
+        char c = mqttClient.read();
+        if (i<127) 
+            buf[i++] = c;
     }
+    buf[i] = '\0';
     
     Serial.println(buf);
 
+    if (mqttManager.isHistoryRequest(topic)) {
+        historyRequested = true;
+        return;
+    }
+
+    String source;
+    if (mqttManager.isLoadHintTopic(topic, source)) {
+        uint8_t level;
+        unsigned long ttlMs;
+        if (mqttManager.parseLoadHint(buf, level, ttlMs) == RES_OK) {
+            xSemaphoreTake(stateLock, portMAX_DELAY);
+            rtc.setLoadHint(source.c_str(), level, ttlMs);
+            xSemaphoreGive(stateLock);
+        }
+        else
+            Log.warning(F("Bad load hint from %s"), source.c_str());
+        return;
+    }
+
     if (buf[0]=='1') {
         oled.displayOn();
         displayOnNotOff = true;
@@ -174,4 +486,4 @@ void onMqttMessage(int messageSize) {
     }
 }
 
-#endif
\ No newline at end of file
+#endif
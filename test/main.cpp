@@ -2,7 +2,6 @@
 #include "RackTempController.h"
 #include "OLEDDisplay.h"
 #include "SevenSegmentRender.h"
-#include <vector>
 
 // Pins
 #define PIN_DC     2        // OLED
@@ -18,7 +17,8 @@ OLED oled(PIN_CS, PIN_DC, PIN_RESET);
 OLEDDisplay oledDisplay(oled);
 SevenSegmentRender ssr(oled);
 
-std::vector<RackState_t> testRackStates;
+// one state, refilled by each fixture in turn; too large to hold several
+RackState_t testState;
 
 // log support
 void printTimestamp(Print* logOutput) {
@@ -31,65 +31,84 @@ void printNewline(Print* logOutput) {
     logOutput->print('\n');
 }
   
-RackState_t testcase_normal_operation() {
-    RackState_t rs;
-    rs.thermos.insert({ "topRack",  {{ 0x28, 0xAA, 0x48, 0x66, 0x53, 0x14, 0x01, 0xD5 }, 21.3, RES_OK } });
-    rs.thermos.insert({ "baseRack", {{ 0x28, 0xAA, 0x51, 0x59, 0x53, 0x14, 0x01, 0x88 }, 21.4, RES_OK } });
-    rs.aveTempCelsius = 21.35;
-    rs.fans.insert({1, { "TL", 100, 1200, 400, 1200, RES_OK } });
-    rs.fans.insert({2, { "TR", 100, 1200, 400, 1200, RES_OK } });
-    rs.fans.insert({3, { "BL", 100, 1150, 400, 1200, RES_OK } });
-    rs.fans.insert({4, { "BR", 100, 1170, 400, 1200, RES_OK } });
-    return rs;
+void testcase_normal_operation(RackState_t& rs) {
+    memset(&rs, 0, sizeof(rs));
+    rs.thermos[THERMO_TOP]  = { PSTR("topRack"),  { 0x28, 0xAA, 0x48, 0x66, 0x53, 0x14, 0x01, 0xD5 }, TEMP_RAW(21.3), RES_OK };
+    rs.thermos[THERMO_BASE] = { PSTR("baseRack"), { 0x28, 0xAA, 0x51, 0x59, 0x53, 0x14, 0x01, 0x88 }, TEMP_RAW(21.4), RES_OK };
+    rs.thermoCount = 2;
+    rs.aveTempRaw = TEMP_RAW(21.35);
+    rs.fans[0] = { PSTR("TL"), 100, 1200, 400, 1200, RES_OK };
+    rs.fans[1] = { PSTR("TR"), 100, 1200, 400, 1200, RES_OK };
+    rs.fans[2] = { PSTR("BL"), 100, 1150, 400, 1200, RES_OK };
+    rs.fans[3] = { PSTR("BR"), 100, 1170, 400, 1200, RES_OK };
+    rs.fanCount = 4;
 }
 
-RackState_t testcase_single_fan_fail() {
-    RackState_t rs = testcase_normal_operation();
-    rs.fans[2].result = ERR_FAN_NOT_OPERATIONAL;
-    rs.fans[2].rpm = 0;
-    return rs;
+void testcase_single_fan_fail(RackState_t& rs) {
+    testcase_normal_operation(rs);
+    rs.fans[1].result = ERR_FAN_NOT_OPERATIONAL;
+    rs.fans[1].rpm = 0;
+    rs.fans[1].fault.state = FAULT_FAULTED;
+    rs.faultSeq = 1;
 }
 
-RackState_t testcase_total_fan_fail() {
-    RackState_t rs = testcase_normal_operation();
-    for(int i=1;i<5;i++) {
+void testcase_total_fan_fail(RackState_t& rs) {
+    testcase_normal_operation(rs);
+    for(int i=0;i<4;i++) {
         rs.fans[i].result = ERR_FAN_NOT_OPERATIONAL;
         rs.fans[i].rpm = 0;
+        rs.fans[i].fault.state = FAULT_FAULTED;
     }
-    return rs;
+    rs.faultSeq = 2;
 }
 
-RackState_t testcase_fan_out_of_range() {
-    RackState_t rs = testcase_normal_operation();
-    rs.fans[3].result = ERR_FAN_TACH;
-    rs.fans[3].rpm = 500;
-    return rs;
+void testcase_fan_out_of_range(RackState_t& rs) {
+    testcase_normal_operation(rs);
+    rs.fans[2].result = ERR_FAN_TACH;
+    rs.fans[2].rpm = 500;
+    rs.fans[2].fault.state = FAULT_SUSPECT;
+    rs.faultSeq = 3;
 }
 
-RackState_t testcase_temps_low() {
-    RackState_t rs = testcase_normal_operation();
-    rs.thermos["topRack"].tempCelsuis = 0.1;
-    return rs;
+void testcase_temps_low(RackState_t& rs) {
+    testcase_normal_operation(rs);
+    rs.thermos[THERMO_TOP].tempRaw = TEMP_RAW(0.1);
 }
 
-RackState_t testcase_thermo_missing() {
-    RackState_t rs = testcase_normal_operation();
-    rs.thermos["topRack"].result = ERR_FAILED_TO_FIND_DEVICE;
-    rs.thermos["topRack"].tempCelsuis = 0.0;
-    rs.thermos["baseRack"].result = ERR_FAILED_TO_FIND_DEVICE;
-    rs.thermos["baseRack"].tempCelsuis = 0.0;
-    return rs;
+void testcase_thermo_missing(RackState_t& rs) {
+    testcase_normal_operation(rs);
+    rs.thermos[THERMO_TOP].result = ERR_FAILED_TO_FIND_DEVICE;
+    rs.thermos[THERMO_TOP].tempRaw = 0;
+    rs.thermos[THERMO_BASE].result = ERR_FAILED_TO_FIND_DEVICE;
+    rs.thermos[THERMO_BASE].tempRaw = 0;
+    rs.thermos[THERMO_BASE].fault.state = FAULT_SUSPECT;
+    rs.thermos[THERMO_TOP].fault.state = FAULT_FAULTED;
+    rs.faultSeq = 4;
 }
 
-RackState_t testcase_allerrs() {
-    RackState_t rs = testcase_thermo_missing();
-    for(int i=1;i<5;i++) {
+void testcase_allerrs(RackState_t& rs) {
+    testcase_thermo_missing(rs);
+    for(int i=0;i<4;i++) {
         rs.fans[i].result = ERR_FAN_NOT_OPERATIONAL;
         rs.fans[i].rpm = 0;
+        rs.fans[i].fault.state = (i % 2) ? FAULT_SUSPECT : FAULT_FAULTED;
     }
-    return rs;    
+    rs.faultSeq = 5;
 }
 
+typedef void (*Testcase_t)(RackState_t& rs);
+
+const Testcase_t testcases[] = {
+    testcase_normal_operation,
+    testcase_single_fan_fail,
+    testcase_total_fan_fail,
+    testcase_fan_out_of_range,
+    testcase_temps_low,
+    testcase_thermo_missing,
+    testcase_allerrs
+};
+#define TESTCASE_COUNT (sizeof(testcases) / sizeof(testcases[0]))
+
 void setup(void)
 {
     Serial.begin(9600);
@@ -100,14 +119,6 @@ void setup(void)
     Log.setSuffix(printNewline);
 
     oledDisplay.initialise();
-
-    testRackStates.push_back(testcase_normal_operation());
-    testRackStates.push_back(testcase_single_fan_fail());
-    testRackStates.push_back(testcase_total_fan_fail());
-    testRackStates.push_back(testcase_fan_out_of_range());
-    testRackStates.push_back(testcase_temps_low());
-    testRackStates.push_back(testcase_thermo_missing());
-    testRackStates.push_back(testcase_allerrs());
 }
 
 /**
@@ -120,21 +131,23 @@ void loop(void) {
     NetworkState_t ns;
     ns.ethernetIP = IPAddress(192, 168, 0, 11);
 
-    RackState_t rs;
+    RackView_t view;
 
     for(int i=0;i<10000;i++) {
         oledDisplay.setOrientation(OLED_Orientation::ROTATE_0);
         oledDisplay.clearDisplay();
-        for(auto it = testRackStates.begin(); it != testRackStates.end(); it++) {
-            rs = *it;
-            oledDisplay.render(rs, ns);
+        for(uint8_t t=0;t<TESTCASE_COUNT;t++) {
+            testcases[t](testState);
+            RackTempController::buildView(testState, view);
+            oledDisplay.render(view, ns);
             delay(500);
         }
         oledDisplay.setOrientation(OLED_Orientation::ROTATE_90);
         oledDisplay.clearDisplay();
-        for(auto it = testRackStates.begin(); it != testRackStates.end(); it++) {
-            rs = *it;
-            oledDisplay.render(rs, ns);
+        for(uint8_t t=0;t<TESTCASE_COUNT;t++) {
+            testcases[t](testState);
+            RackTempController::buildView(testState, view);
+            oledDisplay.render(view, ns);
             delay(500);
         }
     }
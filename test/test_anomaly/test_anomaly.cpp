@@ -0,0 +1,70 @@
+/**
+ * Host tests for AnomalyDetector, run with: pio test -e native
+ */
+#include <unity.h>
+#include "AnomalyDetector.h"
+
+#define SAMPLE_MS 2000UL    // temp task period
+
+static AnomalyDetector detector;
+static unsigned long   nowMs;
+
+// level with a little deterministic noise, +-2, under the 4 sigma floor
+static AnomalyKind_t feed(const int16_t level, const uint16_t i) {
+    nowMs += SAMPLE_MS;
+    return detector.update(level + (int16_t)((i * 7) % 5) - 2, nowMs);
+}
+
+// feeds n samples, returning the first event and where it came
+static AnomalyKind_t feedUntilEvent(const int16_t level, const uint16_t n, uint16_t& at) {
+    for (at = 0; at < n; at++) {
+        AnomalyKind_t kind = feed(level, at);
+        if (kind != ANOMALY_NONE)
+            return kind;
+    }
+    return ANOMALY_NONE;
+}
+
+static void warmUp(const int16_t level) {
+    detector.reset();
+    detector.setMinSd(4);
+    nowMs = 0;
+    uint16_t at;
+    TEST_ASSERT_EQUAL(ANOMALY_NONE, feedUntilEvent(level, 500, at));
+}
+
+void test_excursion_clears(void) {
+    uint16_t at;
+    warmUp(1000);
+
+    TEST_ASSERT_EQUAL(ANOMALY_SHIFT_UP, feedUntilEvent(1008, 100, at));
+    TEST_ASSERT_TRUE(detector.isActive());
+    TEST_ASSERT_EQUAL(ANOMALY_CLEARED, feedUntilEvent(1000, 100, at));
+    TEST_ASSERT_FALSE(detector.isActive());
+}
+
+// a step held far longer than any excursion is rebased, then the
+// detector sees the next shift from the new level
+void test_held_step_rebases(void) {
+    uint16_t at;
+    warmUp(1000);
+
+    TEST_ASSERT_EQUAL(ANOMALY_SHIFT_UP, feedUntilEvent(1008, 100, at));
+    TEST_ASSERT_EQUAL(ANOMALY_REBASED, feedUntilEvent(1008, 2000, at));
+    TEST_ASSERT_FALSE(detector.isActive());
+    TEST_ASSERT_INT_WITHIN(1, 8, detector.getDeviation());
+
+    // quiet at the new level
+    TEST_ASSERT_EQUAL(ANOMALY_NONE, feedUntilEvent(1008, 2000, at));
+
+    // and a second shift, back down, is seen
+    TEST_ASSERT_EQUAL(ANOMALY_SHIFT_DOWN, feedUntilEvent(1000, 100, at));
+    TEST_ASSERT_TRUE(detector.isActive());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_excursion_clears);
+    RUN_TEST(test_held_step_rebases);
+    return UNITY_END();
+}
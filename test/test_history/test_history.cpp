@@ -0,0 +1,115 @@
+/**
+ * Host round-trip tests for HistoryStore, run with: pio test -e native
+ */
+#include <unity.h>
+#include "HistoryStore.h"
+
+#define TEST_RECORDS 600    // enough to wrap the block ring
+
+static HistoryStore    store;
+static HistoryRecord_t written[TEST_RECORDS];
+
+// worst case record: 32 bit time delta of delta, 16 bit value deltas
+static void worstCase(const uint16_t i, HistoryRecord_t& r) {
+    memset(&r, 0, sizeof(r));
+    r.t = (i % 2) ? 0xF0000000UL + i : i;
+    for (uint8_t c = 0; c < HISTORY_CHANNELS; c++)
+        r.v[c] = ((i + c) % 2) ? 16383 : -16384;
+}
+
+// cheapest record, 1 bit each for time and values
+static void repeat(const uint16_t i, HistoryRecord_t& r) {
+    r = written[i-1];
+    r.t += written[i-1].t - written[i-2].t;
+}
+
+// small steps, as a steady period with slowly changing temps
+static void typical(const uint16_t i, HistoryRecord_t& r) {
+    memset(&r, 0, sizeof(r));
+    r.t = 1000 + i * 60 + (i % 3);
+    for (uint8_t c = 0; c < HISTORY_CHANNELS; c++)
+        r.v[c] = 350 + c + (i % 5);
+}
+
+// the retained records decode to the most recent ones written, in order
+static void assertRoundTrip(const uint16_t n) {
+    uint16_t records = store.getRecords();
+    TEST_ASSERT_TRUE(records > 0);
+    TEST_ASSERT_TRUE(records <= n);
+
+    HistoryStore::Reader reader(store);
+    HistoryRecord_t r;
+    uint16_t i = n - records;
+    while (reader.next(r)) {
+        TEST_ASSERT_TRUE(i < n);
+        TEST_ASSERT_EQUAL_UINT32(written[i].t, r.t);
+        for (uint8_t c = 0; c < HISTORY_CHANNELS; c++)
+            TEST_ASSERT_EQUAL_INT16(written[i].v[c], r.v[c]);
+        i++;
+    }
+    TEST_ASSERT_EQUAL_UINT16(n, i);
+}
+
+void test_worst_case_deltas(void) {
+    store.begin(HISTORY_CHANNELS);
+    for (uint16_t i = 0; i < TEST_RECORDS; i++) {
+        worstCase(i, written[i]);
+        store.append(written[i]);
+        assertRoundTrip(i + 1);
+    }
+}
+
+// runs of cheap records between worst cases, so blocks fill to every
+// offset before a worst case record
+void test_worst_case_offsets(void) {
+    for (uint8_t run = 1; run <= 100; run++) {
+        store.begin(0);
+        store.begin(HISTORY_CHANNELS);
+        for (uint16_t i = 0; i < TEST_RECORDS; i++) {
+            if (i < 2 || i % (run + 1) == 0)
+                worstCase(i, written[i]);
+            else
+                repeat(i, written[i]);
+            store.append(written[i]);
+        }
+        assertRoundTrip(TEST_RECORDS);
+    }
+}
+
+void test_typical_deltas(void) {
+    store.begin(0);
+    store.begin(HISTORY_CHANNELS);
+    for (uint16_t i = 0; i < TEST_RECORDS; i++) {
+        typical(i, written[i]);
+        store.append(written[i]);
+    }
+    assertRoundTrip(TEST_RECORDS);
+}
+
+void test_rebase(void) {
+    const int32_t offset = 1700000000L;
+
+    store.begin(0);
+    store.begin(HISTORY_CHANNELS);
+    for (uint16_t i = 0; i < TEST_RECORDS; i++) {
+        typical(i, written[i]);
+        if (i == TEST_RECORDS / 2) {
+            store.rebase(offset);
+            for (uint16_t k = 0; k < i; k++)
+                written[k].t += offset;
+        }
+        if (i >= TEST_RECORDS / 2)
+            written[i].t += offset;
+        store.append(written[i]);
+    }
+    assertRoundTrip(TEST_RECORDS);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_worst_case_deltas);
+    RUN_TEST(test_worst_case_offsets);
+    RUN_TEST(test_typical_deltas);
+    RUN_TEST(test_rebase);
+    return UNITY_END();
+}